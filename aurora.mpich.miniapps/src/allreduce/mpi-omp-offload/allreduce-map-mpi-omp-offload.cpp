@@ -11,6 +11,7 @@
 #include "mpi.h"
 
 #include "mpi_datatype.hpp"
+#include "omp_devices.hpp"
 
 #ifndef ALIGNMENT
 #define ALIGNMENT (2 * 1024 * 1024) // 2MB
@@ -62,6 +63,7 @@ void print_help() {
   std::cout << "Usage: \n";
   std::cout << "options:                                " << '\n';
   std::cout << " -p 2^p elements         default: 25    " << '\n';
+  std::cout << " -d selector             cpu, gpu (default) or index" << '\n';
 }
 
 int main(int argc, char **argv) {
@@ -75,9 +77,10 @@ int main(int argc, char **argv) {
   int nsteps = 10;
   int nblocks = 1;
   bool use_allreduce = false;
+  std::string device_selector = "gpu";
   int opt;
   while (optind < argc) {
-    if ((opt = getopt(argc, argv, "hap:")) != -1) {
+    if ((opt = getopt(argc, argv, "hap:d:")) != -1) {
       switch (opt) {
       case 'h':
         print_help();
@@ -85,6 +88,9 @@ int main(int argc, char **argv) {
       case 'a': // # of blocks
         use_allreduce = true;
         break;
+      case 'd':
+        device_selector = optarg;
+        break;
       case 'p': // 2^p
         int x = atoi(optarg);
         array_size = 1 << x;
@@ -100,11 +106,14 @@ int main(int argc, char **argv) {
 
   using value_t = APP_DATA_TYPE;
 
-  int num_devices = omp_get_num_devices();
   // order devices in round-robin way
-  int device_id = mpi_rank % num_devices;
+  int device_id = select_omp_device(mpi_rank, device_selector);
 
-  omp_set_default_device(device_id);
+  if (device_id == -1) {
+    std::cerr << "No devices\n";
+    MPI_Finalize();
+    exit(1);
+  }
 
   value_t *VA = static_cast<value_t *>(malloc(sizeof(value_t) * array_size));
   value_t *VB = static_cast<value_t *>(malloc(sizeof(value_t) * array_size));
@@ -12,6 +12,7 @@
 #include "mpi.h"
 
 #include "mpi_datatype.hpp"
+#include "omp_devices.hpp"
 
 #ifndef ALIGNMENT
 #define ALIGNMENT (2 * 1024 * 1024) // 2MB
@@ -64,6 +65,7 @@ void print_help() {
   std::cout << " -D                   omp_target_alloc_device" << '\n';
   std::cout << " -S                   omp_target_alloc_shared" << '\n';
   std::cout << "Default allocator:    omp_target_alloc       " << '\n';
+  std::cout << " -d selector          cpu, gpu (default) or index" << '\n';
 }
 
 void error(std::string message, bool rank_zero_only = false) {
@@ -91,9 +93,10 @@ int main(int argc, char **argv) {
   enum { alloc_target = 0, alloc_host, alloc_shared, alloc_device };
   // default: omp_alloc_target
   int allockind = alloc_target;
+  std::string device_selector = "gpu";
 
   while (optind < argc) {
-    if ((opt = getopt(argc, argv, "haHDSp:")) != -1) {
+    if ((opt = getopt(argc, argv, "haHDSp:d:")) != -1) {
       switch (opt) {
       case 'h':
         print_help();
@@ -110,6 +113,9 @@ int main(int argc, char **argv) {
       case 'S':
         allockind = alloc_shared;
         break;
+      case 'd':
+        device_selector = optarg;
+        break;
       case 'p': // 2^p
         int x = atoi(optarg);
         array_size = 1 << x;
@@ -125,18 +131,14 @@ int main(int argc, char **argv) {
 
   using value_t = APP_DATA_TYPE;
 
-  int host_id = omp_get_initial_device();
-
-  int num_devices = omp_get_num_devices();
+  // order devices in round-robin way, before any other OpenMP call
+  int dev_id = select_omp_device(mpi_rank, device_selector);
 
-  if (num_devices == 0) {
+  if (dev_id == -1) {
     error("No devices", true);
   }
 
-  // order devices in round-robin way
-  int dev_id = mpi_rank % num_devices;
-
-  omp_set_default_device(dev_id);
+  int host_id = omp_get_initial_device();
 
   value_t *VA, *VB, *VC;
   size_t bytes = sizeof(value_t) * array_size;
@@ -74,6 +74,8 @@ void print_help() {
   std::cout << " -D                   sycl::usm::alloc::device" << '\n';
   std::cout << " -S                   sycl::usm::alloc::shared (default)"
             << '\n';
+  std::cout << " -d selector          cpu, gpu (default), index or filter"
+            << '\n';
 }
 
 void error(std::string message, bool rank_zero_only = false) {
@@ -102,10 +104,11 @@ int main(int argc, char **argv) {
   int nqueues = 1;
   bool use_allreduce = false;
   sycl::usm::alloc allockind = sycl::usm::alloc::shared;
+  std::string device_selector = "gpu";
 
   int opt;
   while (optind < argc) {
-    if ((opt = getopt(argc, argv, "haHDSp:")) != -1) {
+    if ((opt = getopt(argc, argv, "haHDSp:d:")) != -1) {
       switch (opt) {
       case 'h':
         print_help();
@@ -122,6 +125,9 @@ int main(int argc, char **argv) {
       case 'a':
         use_allreduce = true;
         break;
+      case 'd':
+        device_selector = optarg;
+        break;
       case 'p': // 2^p
         int x = atoi(optarg);
         array_size = 1 << x;
@@ -132,7 +138,7 @@ int main(int argc, char **argv) {
 
   using value_t = APP_DATA_TYPE;
 
-  auto devices = get_devices(mpi_rank, mpi_size, true);
+  auto devices = get_devices(mpi_rank, mpi_size, true, device_selector);
 
   if (devices.empty()) {
     std::cerr << "No devices\n";
@@ -2,6 +2,11 @@
 
 #include <CL/sycl.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <string>
+
 using Devices = std::vector<sycl::device>;
 inline Devices get_devices(const char *target) {
   for (auto &p : sycl::platform::get_platforms()) {
@@ -12,18 +17,60 @@ inline Devices get_devices(const char *target) {
   return Devices();
 }
 
+/** Root devices matching a selector
+ *
+ * CPU devices are pinned one thread per core (unless DPCPP_CPU_PLACES and
+ * DPCPP_CPU_CU_AFFINITY are set), so the runtime must not be initialized yet.
+ * @param selector gpu, cpu, <index> in the list of all the devices, or <filter>
+ * contained in "<platform name>: <device name>"
+ */
+inline Devices select_devices(const std::string &selector) {
+  if (selector != "gpu") {
+    setenv("DPCPP_CPU_PLACES", "cores", 0);
+    setenv("DPCPP_CPU_CU_AFFINITY", "close", 0);
+  }
+  if (selector == "gpu") {
+#if defined(__INTEL_LLVM_COMPILER)
+    // only detect GPUs of a Level-zero platform (cannot use more than 1)
+    return get_devices("Intel(R) OpenCL");
+#else
+    return get_devices("CUDA");
+#endif
+  }
+  if (selector == "cpu")
+    return sycl::device::get_devices(sycl::info::device_type::cpu);
+
+  auto devices = sycl::device::get_devices();
+  if (!selector.empty() &&
+      std::all_of(selector.begin(), selector.end(), ::isdigit)) {
+    size_t index = std::stoul(selector);
+    return index < devices.size() ? Devices{devices[index]} : Devices();
+  }
+  Devices selected;
+  for (auto &d : devices) {
+    auto name = d.get_platform().get_info<sycl::info::platform::name>() +
+                ": " + d.get_info<sycl::info::device::name>();
+    if (name.find(selector) != std::string::npos)
+      selected.push_back(d);
+  }
+  return selected;
+}
+
 /** Create a list of devices for the applications managed by a MPI processor
  *
  * This should be handled by MPI runtime.
  * @param mpi_rank
  * @param mpi_size
  * @param device_fission if true, tiles will be used as a device.
+ * @param selector root devices to use, see select_devices
  */
 inline Devices get_devices(int mpi_rank, int mpi_size,
-                           bool device_fission = true) {
+                           bool device_fission = true,
+                           const std::string &selector = "gpu") {
+  auto gpus = select_devices(selector);
+  if (gpus.empty())
+    return gpus;
 #if defined(__INTEL_LLVM_COMPILER)
-  // only detect GPUs of a Level-zero platform (cannot use more than 1)
-  auto gpus = get_devices("Intel(R) OpenCL");
   Devices all_devices;
   if (device_fission) {
     for (auto &g : gpus) {
@@ -53,7 +100,6 @@ inline Devices get_devices(int mpi_rank, int mpi_size,
   }
 #else
   // cannot create context with multiple devices
-  auto gpus = get_devices("CUDA");
   return Devices{gpus[mpi_rank % gpus.size()]};
 #endif
 }
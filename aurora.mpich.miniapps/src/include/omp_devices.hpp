@@ -0,0 +1,47 @@
+#pragma once
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/** Default device of the applications managed by a MPI processor
+ *
+ * The CPU is the initial device (host fallback of the target regions), its
+ * threads are pinned one per core (unless OMP_PLACES and OMP_PROC_BIND are
+ * set), so the OpenMP runtime must not be initialized yet: no OpenMP call
+ * before this one. A warning is printed if the pinning was ignored (e.g. the
+ * MPI library started OpenMP in MPI_Init).
+ * @param mpi_rank
+ * @param selector gpu (devices in round-robin way), cpu, or <index>
+ * @return the device id, -1 if the selector is not supported
+ */
+inline int select_omp_device(int mpi_rank, const std::string &selector) {
+  int device_id = -1;
+  if (selector == "cpu") {
+    const bool user_bind = std::getenv("OMP_PROC_BIND");
+    setenv("OMP_PLACES", "cores", 0);
+    setenv("OMP_PROC_BIND", "close", 0);
+    device_id = omp_get_initial_device();
+    // The runtime reads OMP_PROC_BIND once, when it starts
+    if (!user_bind && omp_get_proc_bind() != omp_proc_bind_close)
+      std::cerr << "WARNING: OpenMP initialized before select_omp_device, the "
+                   "host threads are not pinned (set OMP_PLACES=cores "
+                   "OMP_PROC_BIND=close)\n";
+  } else if (selector == "gpu") {
+    int num_devices = omp_get_num_devices();
+    if (num_devices > 0)
+      device_id = mpi_rank % num_devices;
+  } else if (!selector.empty() &&
+             std::all_of(selector.begin(), selector.end(), ::isdigit)) {
+    int index = std::stoi(selector);
+    if (index < omp_get_num_devices())
+      device_id = index;
+  }
+  if (device_id != -1)
+    omp_set_default_device(device_id);
+  return device_id;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Buffers kept alive across `bench` calls.
+// A request is served by the smallest free buffer of the same kind big enough to hold it,
+// a new buffer is allocated (and first-touched by the backend) only if none fit.
+class Arena {
+public:
+  using allocator_t = std::function<void *(char kind, size_t bytes)>;
+  using deallocator_t = std::function<void(char kind, void *ptr, size_t bytes)>;
+
+  Arena(allocator_t allocator, deallocator_t deallocator)
+      : allocator(allocator), deallocator(deallocator) {}
+
+  void *acquire(char kind, size_t bytes) {
+    entry_t *best = nullptr;
+    for (auto &e : entries)
+      if (!e.in_use && e.kind == kind && e.bytes >= bytes && (!best || e.bytes < best->bytes))
+        best = &e;
+    if (!best) {
+      entries.push_back({kind, bytes, allocator(kind, bytes), false});
+      best = &entries.back();
+    }
+    best->in_use = true;
+    return best->ptr;
+  }
+
+  void release(void *ptr) {
+    for (auto &e : entries)
+      if (e.ptr == ptr)
+        e.in_use = false;
+  }
+
+  void clear() {
+    for (auto &e : entries)
+      deallocator(e.kind, e.ptr, e.bytes);
+    entries.clear();
+  }
+
+  size_t footprint() const {
+    size_t bytes = 0;
+    for (auto &e : entries)
+      bytes += e.bytes;
+    return bytes;
+  }
+
+private:
+  struct entry_t {
+    char kind;
+    size_t bytes;
+    void *ptr;
+    bool in_use;
+  };
+  std::vector<entry_t> entries;
+  allocator_t allocator;
+  deallocator_t deallocator;
+};
@@ -1,6 +1,9 @@
 #pragma once
+#include <cstdint>
+#include <cstdio>
 #include <vector>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 
@@ -29,13 +32,246 @@ static T busy_wait(size_t N, T i) {
   }
   return y;
 }
+// `K` independent MAD chains, so the issue rate is not bounded by the FMA latency.
+// `T` can be a vector type (`sycl::vec`), `busy_wait_ilp<T, 1>` is `busy_wait<T>`
+template <class T, int K>
+static T busy_wait_ilp(size_t N, T i) {
+  T x[K], y[K];
+  for (int k = 0; k < K; k++) {
+    x[k] = T(1.3f);
+    y[k] = i + T(k);
+  }
+  for (size_t j = 0; j < N; j++)
+    for (int k = 0; k < K; k++) {
+      MAD_64(x[k], y[k]);
+    }
+  T r = y[0];
+  for (int k = 1; k < K; k++)
+    r = r + y[k];
+  return r;
+}
+
+// Precision of the compute kernel ("precision_C") and element type of the buffers ("--dtype")
+enum { PRECISION_FLOAT, PRECISION_DOUBLE, PRECISION_HALF, PRECISION_INT8 };
+
+inline std::string precision_name(size_t precision) {
+  static const char *names[] = {"float", "double", "half", "int8"};
+  return names[precision];
+}
+
+// Call `f(T{})`, `T` being the element type of `dtype`. `bench<T>` is instantiated for each
+// `_Float16` is the half type of both backends (`sycl::half` is not visible from `main`)
+template <class F>
+static void with_dtype(size_t dtype, F &&f) {
+  if (dtype == PRECISION_DOUBLE)
+    f(double{});
+  else if (dtype == PRECISION_HALF)
+    f(_Float16{});
+  else if (dtype == PRECISION_INT8)
+    f(int8_t{});
+  else
+    f(float{});
+}
+
+// Devices the commands are spread over ("devices"):
+//   the selected device, its NUMA sub-devices (tiles, sockets), or every device of its platform
+enum { DEVICES_SINGLE, DEVICES_NUMA, DEVICES_ALL };
+
+// Call `f(std::integral_constant<int, value>{})`, `value` being a power of two up to `Max`
+template <int Max, class F>
+static void with_pow2(size_t value, F &&f) {
+  if constexpr (Max >= 1) {
+    if (value == Max)
+      return f(std::integral_constant<int, Max>{});
+    with_pow2<Max / 2>(value, f);
+  }
+}
+
+// Flop per work-item of the compute kernel: 64 FMA per tripcount per chain and lane
+inline size_t compute_flop(std::unordered_map<std::string, size_t> &commands_parameters) {
+  return 2 * 64 * commands_parameters["tripcount_C"] * commands_parameters["ilp_C"] *
+         commands_parameters["vector_C"];
+}
+
+// One element of the triad, a = b + s * c then `intensity` extra FMA. For the integral types
+// `s` is 3: 0.5 would truncate to 0 (`a = b`, `c` never read), and 1 lets the compiler collapse
+// the FMA chain into a single multiply
+template <class T> constexpr T triad_point(T b, T c, size_t intensity) {
+  const T s = std::is_integral_v<T> ? T(3) : T(0.5);
+  T v = b + s * c;
+  for (size_t k = 0; k < intensity; k++)
+    v = v * s + c;
+  return v;
+}
+
+// One point of the 7-point stencil from its center and the sum of its 6 neighbors, weights
+// summing to 1. For the integral types (2 * center + neighbors) / 8, as 0.4 and 0.1 truncate to
+// 0. `S` is the type of the sum, `int` for `int8_t` so it does not wrap
+template <class T, class S> constexpr T stencil_point(T center, S neighbors) {
+  if constexpr (std::is_integral_v<T>)
+    return T((2 * center + neighbors) >> 3);
+  else
+    return T(0.4) * center + T(0.1) * neighbors;
+}
+
+// int8 kernels still depend on every array they read, so `command_bytes` and `command_flop` hold
+static_assert(triad_point<int8_t>(0, 1, 0) != 0 && triad_point<int8_t>(0, 1, 4) != 0,
+              "int8 triad ignores `c`");
+static_assert(stencil_point<int8_t>(8, 0) != 0 && stencil_point<int8_t>(0, 6 * 8) != 0 &&
+                  stencil_point<int8_t>(8, 6 * 8) == 8,
+              "int8 stencil ignores its points");
+
+// Memory-bound kernels: STREAM triad (T), reduction (R) and 7-point stencil (X).
+// Their arrays are contiguous in the command buffer
+inline bool is_kernel_command(const std::string &command) {
+  return command == "C" || command == "T" || command == "R" || command == "X";
+}
+
+// Shared USM migrations of a 'S' buffer: `prefetch` to the device, `advise` (mem_advise then touch
+// on the device), and `touch_device`/`touch_host` (read and write by a kernel or by the host)
+inline bool is_migration_command(const std::string &command) {
+  return command == "prefetch" || command == "advise" || command == "touch_device" ||
+         command == "touch_host";
+}
+
+// Fills of a device buffer: `fill` with a value of type T, `memset` of its bytes
+inline bool is_fill_command(const std::string &command) {
+  return command == "fill" || command == "memset";
+}
+
+// Exchange of a host buffer with a partner MPI rank ("mpi_command.hpp"), its buffer holds the
+// sent and the received halves
+inline bool is_network_command(const std::string &command) { return command == "N"; }
+
+// Memory kinds of a copy, "A2B:2d(...)" -> "AB"
+inline std::string command_kinds(const std::string &command) {
+  return command.substr(0, command.find(':'));
+}
+
+// Strided copies "A2B:2d(rows,cols,pitch)": `rows` rows of `cols` elements, the rows being
+// `pitch` elements apart in both the source and the destination. Return false if not strided
+struct copy2d_t {
+  size_t rows = 0, cols = 0, pitch = 0;
+};
+
+inline bool parse_copy2d(const std::string &command, copy2d_t &copy2d) {
+  const auto pos = command.find(':');
+  if (pos == std::string::npos)
+    return false;
+  char end = 0;
+  return std::sscanf(command.c_str() + pos, ":2d(%zu,%zu,%zu%c", &copy2d.rows, &copy2d.cols,
+                     &copy2d.pitch, &end) == 4 &&
+         end == ')' && copy2d.rows && copy2d.cols && copy2d.pitch >= copy2d.cols;
+}
+
+inline size_t command_arrays(const std::string &command) {
+  if (command == "T")
+    return 3;
+  if (command == "X" || command == "N")
+    return 2;
+  return 1;
+}
+
+// Elements of the buffer of a command ("R" writes its result after the input)
+inline size_t command_elements(const std::string &command,
+                               std::unordered_map<std::string, size_t> &commands_parameters) {
+  copy2d_t copy2d;
+  if (parse_copy2d(command, copy2d))
+    return copy2d.rows * copy2d.pitch;
+  const auto N = commands_parameters["globalsize_" + command];
+  return command_arrays(command) * N + (command == "R");
+}
+
+// Bytes moved and flop done by one command, for the bandwidth/roofline reports
+inline size_t command_bytes(const std::string &command, size_t sizeof_T,
+                            std::unordered_map<std::string, size_t> &commands_parameters) {
+  if (command == "C")
+    return 0;
+  return command_arrays(command) * commands_parameters["globalsize_" + command] * sizeof_T;
+}
+
+inline size_t command_flop(const std::string &command,
+                           std::unordered_map<std::string, size_t> &commands_parameters) {
+  const auto N = commands_parameters["globalsize_" + command];
+  if (command == "C")
+    return N * compute_flop(commands_parameters);
+  if (command == "T")
+    return 2 * N * (1 + commands_parameters["intensity_T"]);
+  if (command == "R")
+    return N;
+  if (command == "X")
+    return 8 * N;
+  return 0;
+}
+
 extern const std::string alowed_modes;
 
 extern void validate_mode(std::string binname, std::string &mode);
 extern void print_help_and_exit(std::string binname, std::string msg);
 
+// Exit if the backend cannot run `command` (e.g. the memory kinds of a copy)
+extern void validate_command(std::string binname, const std::string &command);
+
+// Select the device from `selector` (cpu | gpu | <index> | <filter>) before any use of the runtime,
+// pinning the host threads when it may be a CPU device: the runtime reads its affinity variables
+// when it starts, so they are set here, one thread per core. Only defaults, the user environment
+// wins. Return a description of the device
+extern std::string select_device(std::string binname, std::string selector);
+
+// Minimum over the repetitions, in us
+struct bench_result_t {
+  long total_time;
+  std::vector<long> commands_times; // Only in "serial" mode
+  long submission_time;             // Host time to submit all the commands
+  // Time of each repetition, for the distributions of the results files
+  std::vector<long> samples;
+  std::vector<std::vector<long>> commands_samples; // Only in "serial" mode
+  std::string mode;                                // Mode run, after the fallbacks of the backend
+  std::vector<long> sweep_times;                   // Only from `bench_sweep`, one per point
+};
+
+template <class T>
+extern bench_result_t bench(std::string mode, std::vector<std::string> &commands, 
+                            std::unordered_map<std::string, size_t> &commands_parameters, 
+                            bool enable_profiling, int n_queues, int n_repetitions, bool verbose = false); 
+
+// Allocate (and first-touch) upfront the buffers needed by each list of commands.
+// They are kept in an arena reused by every call until `release_arena`. Return its size in bytes
+template <class T>
+extern size_t reserve_arena(std::vector<std::vector<std::string>> &l_commands,
+                            std::unordered_map<std::string, size_t> &commands_parameters);
+extern void release_arena();
+
+// Run `commands` replicated 1, 2, 4, ... `max_queues` times on as many queues (or host threads)
+// and return the total time of each point (`sweep_times`). Buffers are acquired once for the
+// largest point
+template <class T>
+extern bench_result_t bench_sweep(std::string mode, std::vector<std::string> &commands,
+                                  std::unordered_map<std::string, size_t> &commands_parameters,
+                                  bool enable_profiling, int max_queues, int n_repetitions,
+                                  bool verbose = false);
+
+// Queues `bench_submission` submits to, `n_queues` being -1 when left to the backend
+extern int submission_queues(std::string mode, int n_queues, int n_host_threads);
+
+// Flood `n_submissions` empty kernels ("C") or single element copies ("A2B", given a 1x1 shape
+// by `main` when strided) and return the time spent submitting them and the total time
+// (submission + completion)
 template <class T>
-extern std::pair<long, std::vector<long>> bench(std::string mode, std::vector<std::string> &commands, 
-                                                std::unordered_map<std::string, size_t> &commands_parameters, 
-                                                bool enable_profiling, int n_queues, int n_repetitions, bool verbose = false); 
+extern std::pair<long, long> bench_submission(std::string mode, std::string command,
+                                              size_t n_submissions, int n_queues,
+                                              int n_host_threads, int n_repetitions,
+                                              bool verbose = false);
 
+// Explicit instantiations, at the end of each backend, for every type of `with_dtype`
+#define INSTANTIATE_BENCH(T)                                                                       \
+  template size_t reserve_arena<T>(std::vector<std::vector<std::string>> &,                        \
+                                   std::unordered_map<std::string, size_t> &);                     \
+  template bench_result_t bench<T>(std::string, std::vector<std::string> &,                        \
+                                   std::unordered_map<std::string, size_t> &, bool, int, int,      \
+                                   bool);                                                          \
+  template bench_result_t bench_sweep<T>(std::string, std::vector<std::string> &,                  \
+                                         std::unordered_map<std::string, size_t> &, bool, int,     \
+                                         int, bool);                                               \
+  template std::pair<long, long> bench_submission<T>(std::string, std::string, size_t, int, int,   \
+                                                     int, bool);
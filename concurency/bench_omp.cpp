@@ -1,142 +1,600 @@
+#include "arena.hpp"
 #include "bench.hpp"
+#include "host_alloc.hpp"
+#include "mpi_command.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <numeric>
 #include <omp.h>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-const std::string alowed_modes = "(nowait | host_threads | serial)";
+const std::string alowed_modes = "(nowait | host_threads | tasks | interop | serial)";
 
 void validate_mode(std::string binname, std::string &mode) {
-  if ((mode != "nowait") && (mode != "host_threads") && (mode != "serial"))
+  if ((mode != "nowait") && (mode != "host_threads") && (mode != "tasks") &&
+      (mode != "interop") && (mode != "serial"))
     print_help_and_exit(binname, "Need to specify: " + alowed_modes);
 }
 
+// No portable prefetch nor mem_advise, and a `target update` of shared memory is not a copy
+void validate_command(std::string binname, const std::string &command) {
+  if (command == "prefetch" || command == "advise")
+    print_help_and_exit(binname, "'" + command + "' is not supported by the OpenMP backend");
+  if (!is_kernel_command(command) && !is_migration_command(command) &&
+      command.find('S') != std::string::npos)
+    print_help_and_exit(binname, "'S' copies are not supported by the OpenMP backend");
+}
+
+// The OpenMP runtime has no device names, so `<filter>` is not supported.
+// `cpu` is the initial device (host fallback of the `target` regions)
+std::string select_device(std::string binname, std::string selector) {
+  const bool is_index =
+      !selector.empty() && std::all_of(selector.begin(), selector.end(), ::isdigit);
+  if (selector != "cpu" && selector != "gpu" && !is_index)
+    print_help_and_exit(binname, "Need to specify (cpu | gpu | <index>) for '--device'");
+  // Affinity of the initial device threads (see bench.hpp). Some runtimes (libgomp) read it when
+  // loaded, or were started by MPI_Init: warn when it was ignored
+  if (selector == "cpu") {
+    const bool user_bind = std::getenv("OMP_PROC_BIND");
+    setenv("OMP_PLACES", "cores", 0);
+    setenv("OMP_PROC_BIND", "close", 0);
+    omp_set_default_device(omp_get_initial_device());
+    if (!user_bind && omp_get_proc_bind() != omp_proc_bind_close)
+      std::cerr << "  WARNING: OpenMP initialized before select_device, the host threads are not "
+                   "pinned (set OMP_PLACES=cores OMP_PROC_BIND=close)"
+                << std::endl;
+  } else if (is_index) {
+    const int index = std::stoi(selector);
+    if (index >= omp_get_num_devices()) {
+      std::cerr << "ERROR: No device " << index << ", " << omp_get_num_devices()
+                << " devices available" << std::endl;
+      std::exit(1);
+    }
+    omp_set_default_device(index);
+  }
+  const int device = omp_get_default_device();
+  if (device == omp_get_initial_device())
+    return "initial device (host)";
+  return "device " + std::to_string(device) + " of " + std::to_string(omp_get_num_devices());
+}
+
+// How the `target` constructs are emitted:
+//   - blocking (`serial`, `host_threads`)
+//   - `nowait`, waited by a global `taskwait`
+//   - `nowait depend(inout: dep)`, commands sharing `dep` form an in-order chain (`tasks`, `interop`)
+enum sync_t { SYNC_BLOCKING, SYNC_NOWAIT, SYNC_DEPEND };
+
+static sync_t get_sync(std::string &mode) {
+  if (mode == "nowait")
+    return SYNC_NOWAIT;
+  if (mode == "tasks" || mode == "interop")
+    return SYNC_DEPEND;
+  return SYNC_BLOCKING;
+}
+
 // No metadirective in most of the compiler so...
 //  UGLY PRAGMA to the rescue!
-template <class T>
-std::pair<long, std::vector<long>>
-bench(std::string mode, std::vector<std::string> &commands,
-      std::unordered_map<std::string, size_t> &commands_parameters, bool enable_profiling,
-      int n_queues, int n_repetitions, bool verbose) {
+#define PRAGMA(x) _Pragma(#x)
+#define OMP_TARGET(sync, dep, directive, ...)                                                      \
+  if (sync == SYNC_BLOCKING) {                                                                     \
+    PRAGMA(omp directive)                                                                          \
+    __VA_ARGS__                                                                                    \
+  } else if (sync == SYNC_NOWAIT) {                                                                \
+    PRAGMA(omp directive nowait)                                                                   \
+    __VA_ARGS__                                                                                    \
+  } else {                                                                                         \
+    PRAGMA(omp directive nowait depend(inout : dep[0]))                                            \
+    __VA_ARGS__                                                                                    \
+  }
 
-  //   ___
-  //    |  ._  o _|_
-  //   _|_ | | |  |_
-  //
-  // Initialize buffers according to the commands
-  if (n_queues == -1)
-    n_queues = (mode == "host_threads") ? commands.size() : 1;
+// `interop` mode: one `targetsync` object per chain. The `target nowait` regions are not bound to
+// its foreign queue, so `interop use` only waits for the dependence of the chain (an included
+// task): a per-chain `taskwait depend` through the interop construct, see the README
+static std::vector<omp_interop_t> create_interops(std::string &mode, int n_chains) {
+  std::vector<omp_interop_t> interops;
+  if (mode != "interop")
+    return interops;
+  for (int q = 0; q < n_chains; q++) {
+    omp_interop_t obj = omp_interop_none;
+#pragma omp interop init(targetsync : obj)
+    interops.push_back(obj);
+  }
+  return interops;
+}
 
-  if (verbose)
-    std::cout << "#n_host_threads used: " << n_queues << std::endl;
+static void wait_interop(omp_interop_t obj, char *dep) {
+#pragma omp interop use(obj) depend(inout : dep[0])
+}
 
+static void destroy_interops(std::vector<omp_interop_t> &interops) {
+  for (auto obj : interops) {
+#pragma omp interop destroy(obj)
+  }
+}
+
+static void *allocate_buffer(char kind, size_t bytes) {
+  void *ptr;
+  // First-touch now (host then device), so page faults are not part of the measurements.
+  // 'M' buffers are touched by `host_alloc` according to the policy
+  if (kind == 'H' || kind == 'S') {
+    ptr = (kind == 'H') ? omp_target_alloc_host(bytes, omp_get_default_device())
+                        : omp_target_alloc_shared(bytes, omp_get_default_device());
+    assert(ptr && "Wrong Allocation");
+    std::memset(ptr, 0, bytes);
+    // Shared memory is already accessible by the device, it must not be mapped
+    if (kind == 'S')
+      return ptr;
+  } else {
+    ptr = host_alloc(bytes, host_policy);
+    // No portable way to register memory to the OpenMP runtime, page-lock it
+    if (host_policy.pin)
+      mlock(ptr, bytes);
+  }
+  char *p = static_cast<char *>(ptr);
+#pragma omp target enter data map(to : p[:bytes])
+  return ptr;
+}
+
+static void free_buffer(char kind, void *ptr, size_t bytes) {
+  if (kind == 'S')
+    return omp_target_free(ptr, omp_get_default_device());
+  char *p = static_cast<char *>(ptr);
+#pragma omp target exit data map(delete : p[:bytes])
+  if (kind == 'H')
+    return omp_target_free(ptr, omp_get_default_device());
+  if (host_policy.pin)
+    munlock(ptr, bytes);
+  host_free(ptr, bytes, host_policy);
+}
+
+static Arena &get_arena() {
+  static Arena arena(allocate_buffer, free_buffer);
+  return arena;
+}
+
+// One mapped buffer per command, the device side is implicit.
+// Migrations use a shared buffer
+template <class T>
+static std::vector<T *> acquire_buffers(std::vector<std::string> &commands,
+                                        std::unordered_map<std::string, size_t> &commands_parameters) {
   std::vector<T *> buffers;
   for (auto &command : commands) {
-    const auto N = commands_parameters["globalsize_" + command];
-    T *ptr;
-    if (command.find("H") != std::string::npos) {
-      ptr = static_cast<T *>(omp_target_alloc_host(N * sizeof(T), omp_get_default_device()));
-    } else {
-      ptr = static_cast<T *>(calloc(N, sizeof(T)));
-    }
-    assert(ptr && "Wrong Allocation");
-#pragma omp target enter data map(alloc : ptr[:N])
-    buffers.push_back(ptr);
+    char kind = (command.find("H") != std::string::npos) ? 'H' : 'M';
+    if (is_migration_command(command))
+      kind = 'S';
+    const auto N = command_elements(command, commands_parameters);
+    buffers.push_back(static_cast<T *>(get_arena().acquire(kind, N * sizeof(T))));
+  }
+  return buffers;
+}
+
+template <class T> static void release_buffers(std::vector<T *> &buffers) {
+  for (const auto &ptr : buffers)
+    get_arena().release(ptr);
+}
+
+template <class T>
+size_t reserve_arena(std::vector<std::vector<std::string>> &l_commands,
+                     std::unordered_map<std::string, size_t> &commands_parameters) {
+  for (auto &commands : l_commands) {
+    auto buffers = acquire_buffers<T>(commands, commands_parameters);
+    release_buffers(buffers);
   }
+  return get_arena().footprint();
+}
+
+void release_arena() { get_arena().clear(); }
+
+// `K` chains in precision `P`, work-items are packed by `V` in SIMD lanes
+template <class T, class P, int K, int V>
+static void submit_compute_kernel(sync_t sync, char *dep, T *ptr, size_t N,
+                                  size_t kernel_tripcount) {
+  OMP_TARGET(sync, dep, target teams distribute parallel for simd simdlen(V),
+             for (int j = 0; j < N; j++) ptr[j] =
+                 static_cast<T>(busy_wait_ilp<P, K>(kernel_tripcount, static_cast<P>(j)));)
+}
+
+template <class T>
+static void submit_compute(sync_t sync, char *dep, T *ptr, size_t N,
+                           std::unordered_map<std::string, size_t> &commands_parameters) {
+  const auto kernel_tripcount = commands_parameters["tripcount_C"];
+  const auto precision = commands_parameters["precision_C"];
+  with_pow2<8>(commands_parameters["ilp_C"], [&](auto ilp) {
+    with_pow2<16>(commands_parameters["vector_C"], [&](auto vector) {
+      constexpr int K = decltype(ilp)::value;
+      constexpr int V = decltype(vector)::value;
+      if (precision == PRECISION_DOUBLE)
+        submit_compute_kernel<T, double, K, V>(sync, dep, ptr, N, kernel_tripcount);
+      else if (precision == PRECISION_HALF)
+        submit_compute_kernel<T, _Float16, K, V>(sync, dep, ptr, N, kernel_tripcount);
+      else if (precision == PRECISION_INT8)
+        submit_compute_kernel<T, int8_t, K, V>(sync, dep, ptr, N, kernel_tripcount);
+      else
+        submit_compute_kernel<T, float, K, V>(sync, dep, ptr, N, kernel_tripcount);
+    });
+  });
+}
+
+// a = b + s * c, with `intensity` extra FMA per element
+template <class T>
+static void submit_triad(sync_t sync, char *dep, T *ptr, size_t N, size_t intensity) {
+  T *a = ptr, *b = ptr + N, *c = ptr + 2 * N;
+  OMP_TARGET(sync, dep, target teams distribute parallel for,
+             for (size_t j = 0; j < N; j++) a[j] = triad_point(b[j], c[j], intensity);)
+}
+
+// Tree reduction done by the runtime, the sum is stored after the input
+template <class T> static void submit_reduction(sync_t sync, char *dep, T *ptr, size_t N) {
+  T *sum = ptr + N;
+  OMP_TARGET(sync, dep, target teams distribute parallel for reduction(+ : sum[:1]),
+             for (size_t j = 0; j < N; j++) sum[0] += ptr[j];)
+}
+
+// 7-point stencil on the largest cube fitting in `N`, boundaries are copied
+template <class T> static void submit_stencil(sync_t sync, char *dep, T *ptr, size_t N) {
+  const size_t n = std::cbrt(N);
+  T *in = ptr, *out = ptr + N;
+  OMP_TARGET(sync, dep, target teams distribute parallel for,
+             for (size_t idx = 0; idx < n * n * n; idx++) {
+               const size_t i = idx % n, j = (idx / n) % n, k = idx / (n * n);
+               if (i == 0 || j == 0 || k == 0 || i == n - 1 || j == n - 1 || k == n - 1)
+                 out[idx] = in[idx];
+               else
+                 out[idx] = stencil_point(in[idx], in[idx - 1] + in[idx + 1] + in[idx - n] +
+                                                       in[idx + n] + in[idx - n * n] +
+                                                       in[idx + n * n]);
+             })
+}
+
+// Read and write every element of a shared buffer, migrating the pages on demand
+template <class T> static void submit_touch_device(sync_t sync, char *dep, T *ptr, size_t N) {
+  OMP_TARGET(sync, dep, target teams distribute parallel for is_device_ptr(ptr),
+             for (size_t j = 0; j < N; j++) ptr[j] += 1;)
+}
+
+template <class T> static void touch_host(T *ptr, size_t N) {
+  for (size_t j = 0; j < N; j++)
+    ptr[j] += 1;
+}
+
+// Work done by the host (touch, runtime copy) is a task when the mode is asynchronous
+template <class F> static void submit_host_task(sync_t sync, char *dep, F f) {
+  if (sync == SYNC_BLOCKING) {
+    f();
+  } else if (sync == SYNC_NOWAIT) {
+#pragma omp task
+    f();
+  } else {
+#pragma omp task depend(inout : dep[0])
+    f();
+  }
+}
+
+template <class T> static void submit_touch_host(sync_t sync, char *dep, T *ptr, size_t N) {
+  submit_host_task(sync, dep, [=]() { touch_host(ptr, N); });
+}
+
+// `value` in every element of the device side of the buffer
+template <class T> static void submit_fill(sync_t sync, char *dep, T *ptr, size_t N, T value) {
+  OMP_TARGET(sync, dep, target teams distribute parallel for,
+             for (size_t j = 0; j < N; j++) ptr[j] = value;)
+}
+
+// No `omp_target_memset` before OpenMP 6.0, a kernel storing bytes
+template <class T> static void submit_memset(sync_t sync, char *dep, T *ptr, size_t N) {
+  unsigned char *p = reinterpret_cast<unsigned char *>(ptr);
+  const size_t bytes = N * sizeof(T);
+  OMP_TARGET(sync, dep, target teams distribute parallel for,
+             for (size_t j = 0; j < bytes; j++) p[j] = 0;)
+}
+
+// Strided copy between the host and the device side of the buffer, same pitch on both sides
+template <class T>
+static void submit_copy2d(sync_t sync, char *dep, T *ptr, const copy2d_t &copy2d, bool to_device) {
+  T *device_ptr;
+#pragma omp target data use_device_ptr(ptr)
+  device_ptr = ptr;
+  submit_host_task(sync, dep, [=]() {
+    const size_t volume[2] = {copy2d.rows, copy2d.cols};
+    const size_t offsets[2] = {0, 0};
+    const size_t dimensions[2] = {copy2d.rows, copy2d.pitch};
+    const int host = omp_get_initial_device(), device = omp_get_default_device();
+    if (to_device)
+      omp_target_memcpy_rect(device_ptr, ptr, sizeof(T), 2, volume, offsets, offsets, dimensions,
+                             dimensions, device, host);
+    else
+      omp_target_memcpy_rect(ptr, device_ptr, sizeof(T), 2, volume, offsets, offsets, dimensions,
+                             dimensions, host, device);
+  });
+}
+
+// Pages of the migrations go back where they come from, so each repetition migrates them again
+template <class T>
+static void reset_residency(std::vector<std::string> &commands, std::vector<T *> &buffers,
+                            std::unordered_map<std::string, size_t> &commands_parameters) {
+  for (int i = 0; i < commands.size(); i++) {
+    const auto N = commands_parameters["globalsize_" + commands[i]];
+    if (commands[i] == "touch_host")
+      submit_touch_device(SYNC_BLOCKING, nullptr, buffers[i], N);
+    else if (is_migration_command(commands[i]))
+      touch_host(buffers[i], N);
+  }
+}
+
+// `index`: position of the command in its list, the same on every rank
+template <class T>
+static void submit_command(sync_t sync, char *dep, const std::string &command, int index, T *ptr,
+                           std::unordered_map<std::string, size_t> &commands_parameters) {
+  const auto N = commands_parameters["globalsize_" + command];
+  if (command == "C") {
+    submit_compute(sync, dep, ptr, N, commands_parameters);
+  } else if (command == "T") {
+    submit_triad(sync, dep, ptr, N, commands_parameters["intensity_T"]);
+  } else if (command == "R") {
+    submit_reduction(sync, dep, ptr, N);
+  } else if (command == "X") {
+    submit_stencil(sync, dep, ptr, N);
+  } else if (command == "touch_device") {
+    submit_touch_device(sync, dep, ptr, N);
+  } else if (command == "touch_host") {
+    submit_touch_host(sync, dep, ptr, N);
+  } else if (is_network_command(command)) {
+    submit_host_task(sync, dep,
+                     [=]() { mpi_command_exchange(ptr, ptr + N, N * sizeof(T), index); });
+  } else if (command == "fill") {
+    submit_fill(sync, dep, ptr, N, T(1));
+  } else if (command == "memset") {
+    submit_memset(sync, dep, ptr, N);
+  } else if (copy2d_t copy2d; parse_copy2d(command, copy2d)) {
+    const auto kinds = command_kinds(command);
+    submit_copy2d(sync, dep, ptr, copy2d, kinds == "MD" || kinds == "HD");
+  } else if (command == "DM" or command == "DH") {
+    OMP_TARGET(sync, dep, target update from(ptr[:N]))
+  } else if (command == "MD" or command == "HD") {
+    OMP_TARGET(sync, dep, target update to(ptr[:N]))
+  }
+}
 
+template <class T>
+static bench_result_t run_commands(std::string mode, std::vector<std::string> &commands,
+                                   std::unordered_map<std::string, size_t> &commands_parameters,
+                                   int n_queues, std::vector<T *> &buffers, int n_repetitions,
+                                   bool verbose) {
   long total_time = std::numeric_limits<long>::max();
+  long submission_time = std::numeric_limits<long>::max();
   std::vector<long> commands_times;
-  if (mode == "serial") {
+  if (mode == "serial")
     std::fill_n(std::back_inserter(commands_times), commands.size(),
                 std::numeric_limits<long>::max());
-    omp_set_num_threads(1);
-  } else if (mode == "host_threads")
-    omp_set_num_threads(n_queues);
+  std::vector<long> samples;
+  std::vector<std::vector<long>> commands_samples(mode == "serial" ? commands.size() : 0);
+
+  // Command `i` is in the chain `i % n_queues`
+  const auto sync = get_sync(mode);
+  std::vector<char> deps(n_queues);
+  auto interops = create_interops(mode, n_queues);
 
   //    _
   //   |_)  _  ._   _ |_
   //   |_) (/_ | | (_ | |
   //
   for (int r = 0; r < n_repetitions; r++) {
+    reset_residency(commands, buffers, commands_parameters);
+    mpi_command_barrier();
     auto s0 = std::chrono::high_resolution_clock::now();
-#ifdef HOST_THREADS
-#pragma omp parallel for
-#endif
+#pragma omp parallel for num_threads(n_queues) if (mode == "host_threads")
     for (int i = 0; i < commands.size(); i++) {
       const auto s = std::chrono::high_resolution_clock::now();
-      const auto N = commands_parameters["globalsize_" + commands[i]];
-      T *ptr = buffers[i];
-      if (commands[i] == "C") {
-        const auto kernel_tripcount = commands_parameters["tripcount_C"];
-#ifdef NOWAIT
-#pragma omp target teams distribute parallel for nowait
-#else
-#pragma omp target teams distribute parallel for
-#endif
-        for (int j = 0; j < N; j++)
-          ptr[j] = busy_wait(kernel_tripcount, (T)j);
-      } else if (commands[i] == "DM" or commands[i] == "DH") {
-#ifdef NOWAIT
-#pragma omp target update from(ptr[:N]) nowait
-#else
-#pragma omp target update from(ptr[:N])
-#endif
-      } else if (commands[i] == "MD" or commands[i] == "HD") {
-#ifdef NOWAIT
-#pragma omp target update to(ptr[:N]) nowait
-#else
-#pragma omp target update to(ptr[:N])
-#endif
-      }
+      submit_command(sync, &deps[i % n_queues], commands[i], i, buffers[i], commands_parameters);
 
       if (mode == "serial") {
-#ifdef NOWAIT
-#pragma omp taskwait
-#endif
         const auto e = std::chrono::high_resolution_clock::now();
         const auto curent_kernel_time =
             std::chrono::duration_cast<std::chrono::microseconds>(e - s).count();
         commands_times[i] = std::min(commands_times[i], curent_kernel_time);
+        commands_samples[i].push_back(curent_kernel_time);
       }
     }
-#ifdef NOWAIT
+    const auto s1 = std::chrono::high_resolution_clock::now();
+    if (mode == "interop") {
+      for (int q = 0; q < n_queues; q++)
+        wait_interop(interops[q], &deps[q]);
+    } else if (sync != SYNC_BLOCKING) {
 #pragma omp taskwait
-#endif
+    }
     // Save time
     const auto e0 = std::chrono::high_resolution_clock::now();
-    const auto curent_total_time =
+    long curent_total_time =
         std::chrono::duration_cast<std::chrono::microseconds>(e0 - s0).count();
+    mpi_command_max(&curent_total_time, 1);
     if (verbose)
       std::cout << "#repetition " << r << ": " << curent_total_time << " us" << std::endl;
     total_time = std::min(total_time, curent_total_time);
+    samples.push_back(curent_total_time);
+    submission_time = std::min(
+        submission_time, std::chrono::duration_cast<std::chrono::microseconds>(s1 - s0).count());
   }
+  destroy_interops(interops);
+
+  mpi_command_max(commands_times.data(), commands_times.size());
+  mpi_command_max(&submission_time, 1);
   // Assume the "best theoritical" serial
   if (mode == "serial")
     total_time =
         std::min(total_time, std::accumulate(commands_times.begin(), commands_times.end(), 0L));
 
+  return {total_time, commands_times, submission_time, samples, commands_samples};
+}
+
+template <class T>
+bench_result_t bench(std::string mode, std::vector<std::string> &commands,
+                     std::unordered_map<std::string, size_t> &commands_parameters,
+                     bool enable_profiling, int n_queues, int n_repetitions, bool verbose) {
+
+  //   ___
+  //    |  ._  o _|_
+  //   _|_ | | |  |_
+  //
+  // Initialize buffers according to the commands
+  if (n_queues == -1)
+    n_queues = (mode == "host_threads" || get_sync(mode) == SYNC_DEPEND) ? commands.size() : 1;
+
+  static bool warned = false;
+  if (commands_parameters["devices"] != DEVICES_SINGLE && !std::exchange(warned, true))
+    std::cerr << "  WARNING: '--devices' not supported by the OpenMP backend, using the default "
+                 "device"
+              << std::endl;
+
+  if (verbose)
+    std::cout << "#n_host_threads/chains used: " << n_queues << std::endl;
+
+  auto buffers = acquire_buffers<T>(commands, commands_parameters);
+
+  auto result =
+      run_commands(mode, commands, commands_parameters, n_queues, buffers, n_repetitions, verbose);
+
   //    _
   //   /  |  _   _. ._      ._
   //   \_ | (/_ (_| | | |_| |_)
   //                        |
-  for (int i = 0; i < buffers.size(); i++) {
-    const auto N = commands_parameters["globalsize_" + commands[i]];
-    auto *ptr = buffers[i];
-#pragma omp target exit data map(delete : ptr[:N])
-    if (commands[i].find("H") != std::string::npos)
-      omp_target_free(ptr, omp_get_default_device());
-    else
-      free(ptr);
+  release_buffers(buffers);
+
+  result.mode = mode;
+  return result;
+}
+
+template <class T>
+bench_result_t bench_sweep(std::string mode, std::vector<std::string> &commands,
+                           std::unordered_map<std::string, size_t> &commands_parameters,
+                           bool enable_profiling, int max_queues, int n_repetitions,
+                           bool verbose) {
+  //   ___
+  //    |  ._  o _|_
+  //   _|_ | | |  |_
+  //
+  // Acquire once for the largest point, smaller points use a prefix of the replicas
+  std::vector<std::string> commands_max;
+  for (int k = 0; k < max_queues; k++)
+    commands_max.insert(commands_max.end(), commands.begin(), commands.end());
+  auto buffers_max = acquire_buffers<T>(commands_max, commands_parameters);
+
+  //    _
+  //   |_)  _  ._   _ |_
+  //   |_) (/_ | | (_ | |
+  //
+  std::vector<long> total_times;
+  for (int n_queues = 1; n_queues <= max_queues; n_queues *= 2) {
+    const auto n_commands = n_queues * commands.size();
+    if (verbose)
+      std::cout << "#n_host_threads/chains used: " << n_queues << std::endl;
+    std::vector<std::string> commands_k(commands_max.begin(), commands_max.begin() + n_commands);
+    std::vector<T *> buffers_k(buffers_max.begin(), buffers_max.begin() + n_commands);
+    const auto result = run_commands(mode, commands_k, commands_parameters, n_queues, buffers_k,
+                                     n_repetitions, verbose);
+    total_times.push_back(result.total_time);
   }
-  return {total_time, commands_times};
+
+  //    _
+  //   /  |  _   _. ._      ._
+  //   \_ | (/_ (_| | | |_| |_)
+  //                        |
+  release_buffers(buffers_max);
+
+  bench_result_t result{};
+  result.mode = mode;
+  result.sweep_times = total_times;
+  return result;
+}
+
+// No queues, each host thread submits its own chain
+int submission_queues(std::string mode, int n_queues, int n_host_threads) { return n_host_threads; }
+
+template <class T>
+std::pair<long, long> bench_submission(std::string mode, std::string command, size_t n_submissions,
+                                       int n_queues, int n_host_threads, int n_repetitions,
+                                       bool verbose) {
+  //   ___
+  //    |  ._  o _|_
+  //   _|_ | | |  |_
+  //
+  // OpenMP has no notion of queue, only host threads matter:
+  //   in `tasks | interop` each host thread submits its own chain
+  if (verbose)
+    std::cout << "#n_host_threads used: " << n_host_threads << std::endl;
+
+  // Other commands work on a single element, the empty kernel doesn't touch memory.
+  // Every parameter is set. `submit_command` reads them with `operator[]`, not guaranteed free of
+  // data races, so each thread has its own copy of the map
+  std::vector<std::string> commands{command};
+  std::unordered_map<std::string, size_t> commands_parameters{{"globalsize_" + command, 1},
+                                                              {"intensity_T", 0}};
+  auto buffers = acquire_buffers<T>(commands, commands_parameters);
+  T *ptr = buffers[0];
+
+  const auto sync = get_sync(mode);
+  std::vector<char> deps(n_host_threads);
+  auto interops = create_interops(mode, n_host_threads);
+
+  long submission_time = std::numeric_limits<long>::max();
+  long total_time = std::numeric_limits<long>::max();
+
+  //    _
+  //   |_)  _  ._   _ |_
+  //   |_) (/_ | | (_ | |
+  //
+  for (int r = 0; r < n_repetitions; r++) {
+    long curent_submission_time = 0;
+    const auto s0 = std::chrono::high_resolution_clock::now();
+    // The implicit barrier at the end of the parallel region waits for all the `nowait` tasks
+#pragma omp parallel num_threads(n_host_threads) reduction(max : curent_submission_time)
+    {
+      char *dep = &deps[omp_get_thread_num()];
+      auto parameters = commands_parameters;
+      const auto s = std::chrono::high_resolution_clock::now();
+#pragma omp for nowait
+      for (size_t j = 0; j < n_submissions; j++) {
+        if (command == "C") {
+          OMP_TARGET(sync, dep, target, {})
+        } else {
+          submit_command(sync, dep, command, 0, ptr, parameters);
+        }
+      }
+      const auto e = std::chrono::high_resolution_clock::now();
+      curent_submission_time = std::chrono::duration_cast<std::chrono::microseconds>(e - s).count();
+      if (mode == "interop")
+        wait_interop(interops[omp_get_thread_num()], dep);
+    }
+    const auto e0 = std::chrono::high_resolution_clock::now();
+    const auto curent_total_time =
+        std::chrono::duration_cast<std::chrono::microseconds>(e0 - s0).count();
+    if (verbose)
+      std::cout << "#repetition " << r << ": " << curent_submission_time << " us (submission) "
+                << curent_total_time << " us (total)" << std::endl;
+    submission_time = std::min(submission_time, curent_submission_time);
+    total_time = std::min(total_time, curent_total_time);
+  }
+
+  //    _
+  //   /  |  _   _. ._      ._
+  //   \_ | (/_ (_| | | |_| |_)
+  //                        |
+  destroy_interops(interops);
+  release_buffers(buffers);
+
+  return {submission_time, total_time};
 }
 
-template std::pair<long, std::vector<long>>
-bench<float>(std::string mode, std::vector<std::string> &commands,
-             std::unordered_map<std::string, size_t> &commands_parameters, bool enable_profiling,
-             int n_queues, int n_repetitions, bool verbose);
+INSTANTIATE_BENCH(float)
+INSTANTIATE_BENCH(double)
+INSTANTIATE_BENCH(_Float16)
+INSTANTIATE_BENCH(int8_t)
@@ -1,39 +1,240 @@
+#include "arena.hpp"
 #include "bench.hpp"
+#include "host_alloc.hpp"
+#include "mpi_command.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <numeric>
 #include <string>
 #include <sycl/sycl.hpp>
+#include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-const std::string alowed_modes = "(in_order | out_of_order | serial)";
+const std::string alowed_modes = "(in_order | out_of_order | graph | serial)";
 
 void validate_mode(std::string binname, std::string &mode) {
-  if ((mode != "in_order") && (mode != "out_of_order") && (mode != "serial"))
+  if ((mode != "in_order") && (mode != "out_of_order") && (mode != "graph") && (mode != "serial"))
     print_help_and_exit(binname, "Need to specify: " + alowed_modes);
 }
 
+// Every kernel, copy (M, D, H, S) and migration is supported
+void validate_command(std::string binname, const std::string &command) {}
+
+static std::string device_selector = "gpu";
+
+// `<index>` in the list of all the devices, else the first device whose
+// "<platform name>: <device name>" contains `<filter>`
+static sycl::device get_selected_device() {
+  if (device_selector == "gpu")
+    return sycl::device{sycl::gpu_selector_v};
+  if (device_selector == "cpu")
+    return sycl::device{sycl::cpu_selector_v};
+  const auto devices = sycl::device::get_devices();
+  if (std::all_of(device_selector.begin(), device_selector.end(), ::isdigit)) {
+    const size_t index = std::stoul(device_selector);
+    if (index < devices.size())
+      return devices[index];
+  }
+  for (const auto &D : devices) {
+    const auto name = D.get_platform().get_info<sycl::info::platform::name>() + ": " +
+                      D.get_info<sycl::info::device::name>();
+    if (name.find(device_selector) != std::string::npos)
+      return D;
+  }
+  std::cerr << "ERROR: No device matching '" << device_selector << "'. Devices available:" << std::endl;
+  for (size_t i = 0; i < devices.size(); i++)
+    std::cerr << "  " << i << ": " << devices[i].get_platform().get_info<sycl::info::platform::name>()
+              << ": " << devices[i].get_info<sycl::info::device::name>() << std::endl;
+  std::exit(1);
+}
+
+// Devices of a `--devices` policy: the selected device, its NUMA sub-devices or its platform
+// peers. Built on first use, so the device is only partitioned when `numa` is asked
+static const std::vector<sycl::device> &get_devices(size_t policy) {
+  static std::vector<sycl::device> devices_sets[3];
+  auto &devices = devices_sets[policy];
+  if (!devices.empty())
+    return devices;
+  const sycl::device D = (policy == DEVICES_SINGLE) ? get_selected_device()
+                                                     : get_devices(DEVICES_SINGLE)[0];
+  devices = {D};
+  if (policy == DEVICES_NUMA) {
+    try {
+      devices = D.create_sub_devices<
+          sycl::info::partition_property::partition_by_affinity_domain>(
+          sycl::info::partition_affinity_domain::numa);
+    } catch (const sycl::exception &) {
+      // Not partitionable, the whole device is its only NUMA domain
+    }
+  } else if (policy == DEVICES_ALL) {
+    devices = D.get_platform().get_devices(D.get_info<sycl::info::device::device_type>());
+  }
+  return devices;
+}
+
+static const sycl::device &get_device() { return get_devices(DEVICES_SINGLE)[0]; }
+
+std::string select_device(std::string binname, std::string selector) {
+  if (selector.empty())
+    print_help_and_exit(binname, "Need to specify (cpu | gpu | <index> | <filter>) for '--device'");
+  device_selector = selector;
+  // Affinity of the CPU device runtime (see bench.hpp), any non-GPU selector may pick it
+  if (selector != "gpu") {
+    setenv("DPCPP_CPU_PLACES", "cores", 0);
+    setenv("DPCPP_CPU_CU_AFFINITY", "close", 0);
+  }
+  const auto &D = get_device();
+  return D.get_platform().get_info<sycl::info::platform::name>() + ": " +
+         D.get_info<sycl::info::device::name>();
+}
+
+// One context per policy, over its devices only: the single device runs in `sycl::context(D)`.
+// It lives for the whole run, so buffers can outlive a `bench` call
+static const sycl::context &get_context(size_t policy) {
+  static std::unique_ptr<sycl::context> contexts[3];
+  if (!contexts[policy])
+    contexts[policy] = std::make_unique<sycl::context>(get_devices(policy));
+  return *contexts[policy];
+}
+
+static void *allocate_buffer(const sycl::context &C, const sycl::device &D, char kind,
+                             size_t bytes) {
+  void *ptr;
+  if (kind == 'M')
+    ptr = host_alloc(bytes, host_policy);
+  else if (kind == 'H')
+    ptr = sycl::malloc_host(bytes, C);
+  else if (kind == 'S')
+    ptr = sycl::malloc_shared(bytes, D, C);
+  else
+    ptr = sycl::malloc_device(bytes, D, C);
+  assert(ptr && "Wrong Allocation");
+
+  // First-touch now, so page faults are not part of the measurements.
+  // 'M' buffers are touched by `host_alloc` according to the policy
+  if (kind != 'M')
+    sycl::queue(C, D).memset(ptr, 0, bytes).wait();
+  else if (host_policy.pin)
+#ifdef SYCL_EXT_ONEAPI_COPY_OPTIMIZE
+    sycl::ext::oneapi::experimental::prepare_for_device_copy(ptr, bytes, C);
+#else
+    mlock(ptr, bytes);
+#endif
+  return ptr;
+}
+
+static void free_buffer(const sycl::context &C, char kind, void *ptr, size_t bytes) {
+  if (kind != 'M')
+    return sycl::free(ptr, C);
+  if (host_policy.pin)
+#ifdef SYCL_EXT_ONEAPI_COPY_OPTIMIZE
+    sycl::ext::oneapi::experimental::release_from_device_copy(ptr, C);
+#else
+    munlock(ptr, bytes);
+#endif
+  host_free(ptr, bytes, host_policy);
+}
+
+// One arena per policy and device, memory is not interchangeable between contexts and devices
+static std::unordered_map<sycl::device, Arena> &get_arenas(size_t policy) {
+  static std::unordered_map<sycl::device, Arena> arenas[3];
+  return arenas[policy];
+}
+
+static Arena &get_arena(size_t policy, const sycl::device &D) {
+  const auto &C = get_context(policy);
+  auto allocator = [&C, D](char kind, size_t bytes) { return allocate_buffer(C, D, kind, bytes); };
+  auto deallocator = [&C](char kind, void *ptr, size_t bytes) { free_buffer(C, kind, ptr, bytes); };
+  return get_arenas(policy).try_emplace(D, allocator, deallocator).first->second;
+}
+
+// One buffer per letter of each command (source and destination of copies).
+// Command `i` runs on the device `i % n_devices`, its buffers are allocated there
 template <class T>
-std::pair<long, std::vector<long>>
-bench(std::string mode, std::vector<std::string> &commands,
-      std::unordered_map<std::string, size_t> &commands_parameters, bool enable_profiling,
-      int n_queues, int n_repetitions, bool verbose) {
+static std::vector<std::vector<T *>>
+acquire_buffers(std::vector<std::string> &commands,
+                std::unordered_map<std::string, size_t> &commands_parameters) {
+  const auto policy = commands_parameters["devices"];
+  const auto &devices = get_devices(policy);
+  std::vector<std::vector<T *>> buffers;
+  for (int i = 0; i < commands.size(); i++) {
+    const auto &command = commands[i];
+    const auto N = command_elements(command, commands_parameters);
+    auto &arena = get_arena(policy, devices[i % devices.size()]);
+    std::vector<T *> buffer;
+    // Kernels and fills work on device memory, migrations on shared memory, MPI on host memory
+    const std::string kinds = (is_kernel_command(command) || is_fill_command(command))
+                                  ? "D"
+                                  : (is_migration_command(command)  ? "S"
+                                     : is_network_command(command) ? "M"
+                                                                    : command_kinds(command));
+    for (auto kind : kinds)
+      buffer.push_back(static_cast<T *>(arena.acquire(kind, N * sizeof(T))));
+    buffers.push_back(buffer);
+  }
+  return buffers;
+}
 
-  //   ___
-  //    |  ._  o _|_
-  //   _|_ | | |  |_
-  //
-  if (n_queues == -1)
-    n_queues = (mode == "in_order") ? commands.size() : 1;
+template <class T> static void release_buffers(std::vector<std::vector<T *>> &buffers) {
+  for (const auto &buffer : buffers)
+    for (const auto &ptr : buffer)
+      for (const auto policy : {DEVICES_SINGLE, DEVICES_NUMA, DEVICES_ALL})
+        for (auto &[D, arena] : get_arenas(policy))
+          arena.release(ptr);
+}
 
-  if (verbose)
-    std::cout << "#n_queues used: " << n_queues << std::endl;
+template <class T>
+size_t reserve_arena(std::vector<std::vector<std::string>> &l_commands,
+                     std::unordered_map<std::string, size_t> &commands_parameters) {
+  for (auto &commands : l_commands) {
+    auto buffers = acquire_buffers<T>(commands, commands_parameters);
+    release_buffers(buffers);
+  }
+  size_t bytes = 0;
+  for (const auto policy : {DEVICES_SINGLE, DEVICES_NUMA, DEVICES_ALL})
+    for (const auto &[D, arena] : get_arenas(policy))
+      bytes += arena.footprint();
+  return bytes;
+}
+
+void release_arena() {
+  for (const auto policy : {DEVICES_SINGLE, DEVICES_NUMA, DEVICES_ALL})
+    for (auto &[D, arena] : get_arenas(policy))
+      arena.clear();
+}
+
+// Not every implementation (e.g. CPU devices) can record graphs, and a graph targets one device:
+// several sub-devices/devices (`--devices numa|all`) fall back too
+static void fallback_graph_mode(std::string &mode, const std::vector<sycl::device> &devices) {
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+  if (mode != "graph" ||
+      (devices.size() == 1 && devices[0].has(sycl::aspect::ext_oneapi_limited_graph)))
+    return;
+#else
+  if (mode != "graph")
+    return;
+#endif
+  static bool warned = false;
+  if (!std::exchange(warned, true))
+    std::cerr << "  WARNING: sycl_ext_oneapi_graph not supported"
+              << (devices.size() > 1 ? " on several devices" : "")
+              << ", falling back to out_of_order" << std::endl;
+  mode = "out_of_order";
+}
 
-  const sycl::device D{sycl::gpu_selector_v};
-  const sycl::context C(D);
+// Queue `q` is on the device `q % n_devices`
+static std::vector<sycl::queue> create_queues(std::string mode, bool enable_profiling, int n_queues,
+                                              const std::vector<sycl::device> &devices,
+                                              const sycl::context &C) {
   // By default SYCL queue are out-of-order
   sycl::property_list pl;
   if ((mode == "in_order") && enable_profiling)
@@ -49,56 +250,251 @@ bench(std::string mode, std::vector<std::string> &commands,
   // This copy queue and hence sharing the native objects.
   std::vector<sycl::queue> Qs;
   for (size_t i = 0; i < n_queues; i++)
-    Qs.push_back(sycl::queue(C, D, pl));
+    Qs.push_back(sycl::queue(C, devices[i % devices.size()], pl));
 
-  // Initialize buffers according to the commands
-  std::vector<std::vector<T *>> buffers;
-  for (auto &command : commands) {
-    const auto N = commands_parameters["globalsize_" + command];
-    std::vector<T *> buffer;
-    for (auto c : command) {
-      if (c == 'C')
-        buffer.push_back(sycl::malloc_device<T>(N, D, C));
-      else if (c == 'M')
-        buffer.push_back(static_cast<T *>(calloc(N, sizeof(T))));
-      else if (c == 'D')
-        buffer.push_back(sycl::malloc_device<T>(N, D, C));
-      else if (c == 'H')
-        buffer.push_back(sycl::malloc_host<T>(N, C));
-      else if (c == 'S')
-        buffer.push_back(sycl::malloc_shared<T>(N, D, C));
+  return Qs;
+}
+
+// `K` chains of `V` lanes in precision `P`, the lanes are summed so none is optimized away
+template <class T, class P, int K, int V>
+static void submit_compute_kernel(sycl::queue &Q, T *ptr, size_t N, size_t kernel_tripcount) {
+  Q.parallel_for(sycl::range{N}, [ptr, kernel_tripcount](sycl::id<1> j) {
+    if constexpr (V == 1) {
+      ptr[j] = static_cast<T>(busy_wait_ilp<P, K>(kernel_tripcount, static_cast<P>(j)));
+    } else {
+      using A = sycl::vec<P, V>;
+      const A r = busy_wait_ilp<A, K>(kernel_tripcount, A(static_cast<P>(j)));
+      P s = r[0];
+      for (int v = 1; v < V; v++)
+        s += r[v];
+      ptr[j] = static_cast<T>(s);
     }
-    buffers.push_back(buffer);
+  });
+}
+
+template <class T>
+static void submit_compute(sycl::queue &Q, T *ptr, size_t N,
+                           std::unordered_map<std::string, size_t> &commands_parameters) {
+  const auto kernel_tripcount = commands_parameters["tripcount_C"];
+  const auto precision = commands_parameters["precision_C"];
+  with_pow2<8>(commands_parameters["ilp_C"], [&](auto ilp) {
+    with_pow2<16>(commands_parameters["vector_C"], [&](auto vector) {
+      constexpr int K = decltype(ilp)::value;
+      constexpr int V = decltype(vector)::value;
+      if (precision == PRECISION_DOUBLE)
+        submit_compute_kernel<T, double, K, V>(Q, ptr, N, kernel_tripcount);
+      else if (precision == PRECISION_HALF)
+        submit_compute_kernel<T, sycl::half, K, V>(Q, ptr, N, kernel_tripcount);
+      else if (precision == PRECISION_INT8)
+        submit_compute_kernel<T, int8_t, K, V>(Q, ptr, N, kernel_tripcount);
+      else
+        submit_compute_kernel<T, float, K, V>(Q, ptr, N, kernel_tripcount);
+    });
+  });
+}
+
+// a = b + s * c, with `intensity` extra FMA per element
+template <class T> static void submit_triad(sycl::queue &Q, T *ptr, size_t N, size_t intensity) {
+  T *a = ptr, *b = ptr + N, *c = ptr + 2 * N;
+  Q.parallel_for(sycl::range{N}, [a, b, c, intensity](sycl::id<1> j) {
+    a[j] = triad_point(b[j], c[j], intensity);
+  });
+}
+
+// Tree reduction done by the runtime, the sum is stored after the input
+template <class T> static void submit_reduction(sycl::queue &Q, T *ptr, size_t N) {
+  T *sum = ptr + N;
+  Q.parallel_for(sycl::range{N}, sycl::reduction(sum, sycl::plus<T>()),
+                 [ptr](sycl::id<1> j, auto &s) { s += ptr[j]; });
+}
+
+// 7-point stencil on the largest cube fitting in `N`, boundaries are copied
+template <class T> static void submit_stencil(sycl::queue &Q, T *ptr, size_t N) {
+  const size_t n = std::cbrt(N);
+  T *in = ptr, *out = ptr + N;
+  Q.parallel_for(sycl::range{n * n * n}, [in, out, n](sycl::id<1> idx) {
+    const size_t i = idx % n, j = (idx / n) % n, k = idx / (n * n);
+    if (i == 0 || j == 0 || k == 0 || i == n - 1 || j == n - 1 || k == n - 1) {
+      out[idx] = in[idx];
+      return;
+    }
+    out[idx] = stencil_point(in[idx], in[idx - 1] + in[idx + 1] + in[idx - n] + in[idx + n] +
+                                          in[idx - n * n] + in[idx + n * n]);
+  });
+}
+
+// Read and write every element, migrating the pages on demand
+template <class T>
+static void submit_touch_device(sycl::queue &Q, T *ptr, size_t N,
+                                std::vector<sycl::event> deps = {}) {
+  Q.submit([&](sycl::handler &h) {
+    h.depends_on(deps);
+    h.parallel_for(sycl::range{N}, [ptr](sycl::id<1> j) { ptr[j] += 1; });
+  });
+}
+
+template <class T> static void touch_host(T *ptr, size_t N) {
+  for (size_t j = 0; j < N; j++)
+    ptr[j] += 1;
+}
+
+// Pages of the migrations go back where they come from, so each repetition migrates them again
+template <class T>
+static void reset_residency(std::vector<sycl::queue> &Qs, std::vector<std::string> &commands,
+                            std::vector<std::vector<T *>> &buffers,
+                            std::unordered_map<std::string, size_t> &commands_parameters) {
+  for (int i = 0; i < commands.size(); i++) {
+    const auto N = commands_parameters["globalsize_" + commands[i]];
+    if (commands[i] == "touch_host")
+      submit_touch_device(Qs[i % Qs.size()], buffers[i][0], N);
+    else if (is_migration_command(commands[i]))
+      touch_host(buffers[i][0], N);
+  }
+  for (auto &Q : Qs)
+    Q.wait();
+}
+
+// Same pitch for the source and the destination. Without the extension, one copy per row
+template <class T>
+static void submit_copy2d(sycl::queue &Q, const T *src, T *dest, const copy2d_t &copy2d) {
+#ifdef SYCL_EXT_ONEAPI_MEMCPY2D
+  Q.ext_oneapi_copy2d(src, copy2d.pitch, dest, copy2d.pitch, copy2d.cols, copy2d.rows);
+#else
+  for (size_t r = 0; r < copy2d.rows; r++)
+    Q.copy(src + r * copy2d.pitch, dest + r * copy2d.pitch, copy2d.cols);
+#endif
+}
+
+// `index`: position of the command in its list, the same on every rank
+template <class T>
+static void submit_command(sycl::queue &Q, const std::string &command, int index,
+                           std::vector<T *> &buffer,
+                           std::unordered_map<std::string, size_t> &commands_parameters) {
+  const auto N = commands_parameters["globalsize_" + command];
+  if (command == "C") {
+    submit_compute(Q, buffer[0], N, commands_parameters);
+  } else if (command == "T") {
+    submit_triad(Q, buffer[0], N, commands_parameters["intensity_T"]);
+  } else if (command == "R") {
+    submit_reduction(Q, buffer[0], N);
+  } else if (command == "X") {
+    submit_stencil(Q, buffer[0], N);
+  } else if (command == "prefetch") {
+    Q.prefetch(buffer[0], N * sizeof(T));
+  } else if (command == "advise") {
+    const auto e = Q.mem_advise(buffer[0], N * sizeof(T), commands_parameters["advice"]);
+    submit_touch_device(Q, buffer[0], N, {e});
+  } else if (command == "touch_device") {
+    submit_touch_device(Q, buffer[0], N);
+  } else if (command == "touch_host") {
+    T *ptr = buffer[0];
+    Q.submit([&](sycl::handler &h) { h.host_task([ptr, N]() { touch_host(ptr, N); }); });
+  } else if (is_network_command(command)) {
+    T *ptr = buffer[0];
+    Q.submit([&](sycl::handler &h) {
+      h.host_task([ptr, N, index]() { mpi_command_exchange(ptr, ptr + N, N * sizeof(T), index); });
+    });
+  } else if (command == "fill") {
+    Q.fill(buffer[0], T(1), N);
+  } else if (command == "memset") {
+    Q.memset(buffer[0], 0, N * sizeof(T));
+  } else if (copy2d_t copy2d; parse_copy2d(command, copy2d)) {
+    submit_copy2d(Q, buffer[0], buffer[1], copy2d);
+  } else {
+    // Copy is src -> dest
+    Q.copy(buffer[0], buffer[1], N);
+  }
+}
+
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+namespace sycl_ext = sycl::ext::oneapi::experimental;
+
+// Record the commands once, then only replay the executable graph
+template <class T>
+static bench_result_t run_graph(std::vector<std::string> &commands,
+                                std::unordered_map<std::string, size_t> &commands_parameters,
+                                std::vector<sycl::queue> &Qs,
+                                std::vector<std::vector<T *>> &buffers, int n_repetitions,
+                                bool verbose) {
+  const int n_queues = Qs.size();
+  const auto s = std::chrono::high_resolution_clock::now();
+  // The device of the queues, a sub-device with `--devices numa` (one device, see
+  // `fallback_graph_mode`)
+  sycl_ext::command_graph graph{Qs[0].get_context(), Qs[0].get_device()};
+  graph.begin_recording(Qs);
+  for (int i = 0; i < commands.size(); i++)
+    submit_command(Qs[i % n_queues], commands[i], i, buffers[i], commands_parameters);
+  graph.end_recording();
+  auto exec_graph = graph.finalize();
+  const auto e = std::chrono::high_resolution_clock::now();
+  if (verbose)
+    std::cout << "#graph recording and finalization: "
+              << std::chrono::duration_cast<std::chrono::microseconds>(e - s).count() << " us"
+              << std::endl;
+
+  long total_time = std::numeric_limits<long>::max();
+  long submission_time = std::numeric_limits<long>::max();
+  std::vector<long> samples;
+  //    _
+  //   |_)  _  ._   _ |_
+  //   |_) (/_ | | (_ | |
+  //
+  for (int r = 0; r < n_repetitions; r++) {
+    reset_residency(Qs, commands, buffers, commands_parameters);
+    mpi_command_barrier();
+    const auto s0 = std::chrono::high_resolution_clock::now();
+    Qs[0].ext_oneapi_graph(exec_graph);
+    const auto s1 = std::chrono::high_resolution_clock::now();
+    Qs[0].wait();
+    const auto e0 = std::chrono::high_resolution_clock::now();
+    long curent_total_time =
+        std::chrono::duration_cast<std::chrono::microseconds>(e0 - s0).count();
+    mpi_command_max(&curent_total_time, 1);
+    if (verbose)
+      std::cout << "#repetition " << r << ": " << curent_total_time << " us" << std::endl;
+    total_time = std::min(total_time, curent_total_time);
+    samples.push_back(curent_total_time);
+    submission_time = std::min(
+        submission_time, std::chrono::duration_cast<std::chrono::microseconds>(s1 - s0).count());
   }
+  mpi_command_max(&submission_time, 1);
+  return {total_time, {}, submission_time, samples};
+}
+#endif
 
+template <class T>
+static bench_result_t run_commands(std::string mode, std::vector<std::string> &commands,
+                                   std::unordered_map<std::string, size_t> &commands_parameters,
+                                   std::vector<sycl::queue> &Qs,
+                                   std::vector<std::vector<T *>> &buffers, int n_repetitions,
+                                   bool verbose) {
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+  if (mode == "graph")
+    return run_graph(commands, commands_parameters, Qs, buffers, n_repetitions, verbose);
+#endif
+  const int n_queues = Qs.size();
   long total_time = std::numeric_limits<long>::max();
+  long submission_time = std::numeric_limits<long>::max();
   std::vector<long> commands_times;
   if (mode == "serial")
     std::fill_n(std::back_inserter(commands_times), commands.size(),
                 std::numeric_limits<long>::max());
+  std::vector<long> samples;
+  std::vector<std::vector<long>> commands_samples(mode == "serial" ? commands.size() : 0);
 
   //    _
   //   |_)  _  ._   _ |_
   //   |_) (/_ | | (_ | |
   //
   for (int r = 0; r < n_repetitions; r++) {
+    reset_residency(Qs, commands, buffers, commands_parameters);
+    mpi_command_barrier();
     auto s0 = std::chrono::high_resolution_clock::now();
     // Run all commands
     for (int i = 0; i < commands.size(); i++) {
       const auto s = std::chrono::high_resolution_clock::now();
       sycl::queue Q = Qs[i % n_queues];
-      const auto N = commands_parameters["globalsize_" + commands[i]];
-
-      if (commands[i] == "C") {
-        T *ptr = buffers[i][0];
-        const auto kernel_tripcount = commands_parameters["tripcount_C"];
-        Q.parallel_for(sycl::range{N}, [ptr, kernel_tripcount](sycl::id<1> j) {
-          ptr[j] = busy_wait(kernel_tripcount, (T)j);
-        });
-      } else {
-        // Copy is src -> dest
-        Q.copy(buffers[i][0], buffers[i][1], N);
-      }
+      submit_command(Q, commands[i], i, buffers[i], commands_parameters);
 
       if (mode == "serial") {
         Q.wait();
@@ -106,39 +502,220 @@ bench(std::string mode, std::vector<std::string> &commands,
         const auto curent_kernel_time =
             std::chrono::duration_cast<std::chrono::microseconds>(e - s).count();
         commands_times[i] = std::min(commands_times[i], curent_kernel_time);
+        commands_samples[i].push_back(curent_kernel_time);
       }
     }
+    const auto s1 = std::chrono::high_resolution_clock::now();
     // Sync all queues
     for (auto &Q : Qs)
       Q.wait();
     // Save time
     const auto e0 = std::chrono::high_resolution_clock::now();
-    const auto curent_total_time =
+    long curent_total_time =
         std::chrono::duration_cast<std::chrono::microseconds>(e0 - s0).count();
+    mpi_command_max(&curent_total_time, 1);
     if (verbose)
       std::cout << "#repetition " << r << ": " << curent_total_time << " us" << std::endl;
     total_time = std::min(total_time, curent_total_time);
+    samples.push_back(curent_total_time);
+    submission_time = std::min(
+        submission_time, std::chrono::duration_cast<std::chrono::microseconds>(s1 - s0).count());
   }
 
+  mpi_command_max(commands_times.data(), commands_times.size());
+  mpi_command_max(&submission_time, 1);
   // Assume the "best theoritical" serial
   if (mode == "serial")
     total_time =
         std::min(total_time, std::accumulate(commands_times.begin(), commands_times.end(), 0L));
 
+  return {total_time, commands_times, submission_time, samples, commands_samples};
+}
+
+template <class T>
+bench_result_t bench(std::string mode, std::vector<std::string> &commands,
+                     std::unordered_map<std::string, size_t> &commands_parameters,
+                     bool enable_profiling, int n_queues, int n_repetitions, bool verbose) {
+
+  //   ___
+  //    |  ._  o _|_
+  //   _|_ | | |  |_
+  //
+  const auto &devices = get_devices(commands_parameters["devices"]);
+  const int n_devices = devices.size();
+  static bool warned = false;
+  if (commands_parameters["devices"] != DEVICES_SINGLE && n_devices == 1 &&
+      !std::exchange(warned, true))
+    std::cerr << "  WARNING: only one device found, the aggregate is the single device" << std::endl;
+  fallback_graph_mode(mode, devices);
+  if (n_queues == -1)
+    n_queues = (mode == "in_order") ? commands.size() : 1;
+  // Command `i` must land on a queue of the device `i % n_devices`
+  n_queues = (n_queues + n_devices - 1) / n_devices * n_devices;
+
+  if (verbose)
+    std::cout << "#n_queues used: " << n_queues << " | n_devices used: " << n_devices
+              << std::endl;
+
+  std::vector<sycl::queue> Qs =
+      create_queues(mode, enable_profiling, n_queues, devices,
+                    get_context(commands_parameters["devices"]));
+
+  // Initialize buffers according to the commands
+  auto buffers = acquire_buffers<T>(commands, commands_parameters);
+
+  auto result =
+      run_commands(mode, commands, commands_parameters, Qs, buffers, n_repetitions, verbose);
+
   //    _
   //   /  |  _   _. ._      ._
   //   \_ | (/_ (_| | | |_| |_)
   //                        |
-  for (const auto &buffer : buffers)
-    for (const auto &ptr : buffer)
-      // Shorter than to remember commands types...
-      (sycl::get_pointer_type(ptr, C) != sycl::usm::alloc::unknown) ? sycl::free(ptr, C)
-                                                                    : free(ptr);
+  release_buffers(buffers);
+
+  result.mode = mode;
+  return result;
+}
+
+template <class T>
+bench_result_t bench_sweep(std::string mode, std::vector<std::string> &commands,
+                           std::unordered_map<std::string, size_t> &commands_parameters,
+                           bool enable_profiling, int max_queues, int n_repetitions,
+                           bool verbose) {
+  //   ___
+  //    |  ._  o _|_
+  //   _|_ | | |  |_
+  //
+  const auto &devices = get_devices(commands_parameters["devices"]);
+  const int n_devices = devices.size();
+  fallback_graph_mode(mode, devices);
+  // As in `bench`, the number of queues is a multiple of the number of devices
+  auto round_queues = [n_devices](int n) { return (n + n_devices - 1) / n_devices * n_devices; };
+  std::vector<sycl::queue> Qs_max =
+      create_queues(mode, enable_profiling, round_queues(max_queues), devices,
+                    get_context(commands_parameters["devices"]));
+
+  // Acquire once for the largest point, smaller points use a prefix of the replicas
+  std::vector<std::string> commands_max;
+  for (int k = 0; k < max_queues; k++)
+    commands_max.insert(commands_max.end(), commands.begin(), commands.end());
+  auto buffers_max = acquire_buffers<T>(commands_max, commands_parameters);
+
+  //    _
+  //   |_)  _  ._   _ |_
+  //   |_) (/_ | | (_ | |
+  //
+  std::vector<long> total_times;
+  for (int n_queues = 1; n_queues <= max_queues; n_queues *= 2) {
+    const auto n_commands = n_queues * commands.size();
+    if (verbose)
+      std::cout << "#n_queues used: " << n_queues << std::endl;
+    std::vector<sycl::queue> Qs(Qs_max.begin(), Qs_max.begin() + round_queues(n_queues));
+    std::vector<std::string> commands_k(commands_max.begin(), commands_max.begin() + n_commands);
+    std::vector<std::vector<T *>> buffers_k(buffers_max.begin(), buffers_max.begin() + n_commands);
+    const auto result =
+        run_commands(mode, commands_k, commands_parameters, Qs, buffers_k, n_repetitions, verbose);
+    total_times.push_back(result.total_time);
+  }
+
+  //    _
+  //   /  |  _   _. ._      ._
+  //   \_ | (/_ (_| | | |_| |_)
+  //                        |
+  release_buffers(buffers_max);
+
+  bench_result_t result{};
+  result.mode = mode;
+  result.sweep_times = total_times;
+  return result;
+}
+
+// One in-order queue per host thread, they would serialize on a shared one
+int submission_queues(std::string mode, int n_queues, int n_host_threads) {
+  if (n_queues == -1)
+    return (mode == "in_order") ? n_host_threads : 1;
+  return n_queues;
+}
+
+template <class T>
+std::pair<long, long> bench_submission(std::string mode, std::string command, size_t n_submissions,
+                                       int n_queues, int n_host_threads, int n_repetitions,
+                                       bool verbose) {
+  //   ___
+  //    |  ._  o _|_
+  //   _|_ | | |  |_
+  //
+  n_queues = submission_queues(mode, n_queues, n_host_threads);
+  if (verbose)
+    std::cout << "#n_queues used: " << n_queues << std::endl;
+
+  std::vector<sycl::queue> Qs = create_queues(mode, false, n_queues, get_devices(DEVICES_SINGLE),
+                                              get_context(DEVICES_SINGLE));
+
+  // Other commands work on a single element, the empty kernel doesn't touch memory.
+  // Every parameter is set. `submit_command` reads them with `operator[]`, not guaranteed free of
+  // data races, so each thread has its own copy of the map
+  std::vector<std::string> commands{command};
+  std::unordered_map<std::string, size_t> commands_parameters{
+      {"globalsize_" + command, 1}, {"intensity_T", 0}, {"advice", 0}, {"devices", DEVICES_SINGLE}};
+  auto buffers = acquire_buffers<T>(commands, commands_parameters);
+  auto &buffer = buffers[0];
+
+  long submission_time = std::numeric_limits<long>::max();
+  long total_time = std::numeric_limits<long>::max();
+
+  //    _
+  //   |_)  _  ._   _ |_
+  //   |_) (/_ | | (_ | |
+  //
+  for (int r = 0; r < n_repetitions; r++) {
+    std::vector<long> threads_submission_time(n_host_threads);
+    std::vector<std::thread> threads;
+    const auto s0 = std::chrono::high_resolution_clock::now();
+    // Submission `j` goes to queue `j % n_queues`, whatever the thread submitting it
+    for (int t = 0; t < n_host_threads; t++)
+      threads.emplace_back([&, t, parameters = commands_parameters]() mutable {
+        const auto s = std::chrono::high_resolution_clock::now();
+        for (size_t j = t; j < n_submissions; j += n_host_threads) {
+          sycl::queue Q = Qs[j % n_queues];
+          if (command == "C")
+            Q.parallel_for(sycl::range{1}, [](sycl::id<1>) {});
+          else
+            submit_command(Q, command, 0, buffer, parameters);
+          if (mode == "serial")
+            Q.wait();
+        }
+        const auto e = std::chrono::high_resolution_clock::now();
+        threads_submission_time[t] =
+            std::chrono::duration_cast<std::chrono::microseconds>(e - s).count();
+      });
+    for (auto &thread : threads)
+      thread.join();
+    // Sync all queues
+    for (auto &Q : Qs)
+      Q.wait();
+    const auto e0 = std::chrono::high_resolution_clock::now();
+    const auto curent_submission_time =
+        *std::max_element(threads_submission_time.begin(), threads_submission_time.end());
+    const auto curent_total_time =
+        std::chrono::duration_cast<std::chrono::microseconds>(e0 - s0).count();
+    if (verbose)
+      std::cout << "#repetition " << r << ": " << curent_submission_time << " us (submission) "
+                << curent_total_time << " us (total)" << std::endl;
+    submission_time = std::min(submission_time, curent_submission_time);
+    total_time = std::min(total_time, curent_total_time);
+  }
+
+  //    _
+  //   /  |  _   _. ._      ._
+  //   \_ | (/_ (_| | | |_| |_)
+  //                        |
+  release_buffers(buffers);
 
-  return {total_time, commands_times};
+  return {submission_time, total_time};
 }
 
-template std::pair<long, std::vector<long>>
-bench<float>(std::string mode, std::vector<std::string> &commands,
-             std::unordered_map<std::string, size_t> &commands_parameters, bool enable_profiling,
-             int n_queues, int n_repetitions, bool verbose);
+INSTANTIATE_BENCH(float)
+INSTANTIATE_BENCH(double)
+INSTANTIATE_BENCH(_Float16)
+INSTANTIATE_BENCH(int8_t)
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+# Compare two results files of `--output <file>.jsonl` (baseline, then current).
+# Records are matched on (binary, mode, dtype, device, ranks, commands, environment).
+# A time is a regression when its median is slower by more than `--threshold` AND the
+# samples are slower with a one-sided Mann-Whitney U test at level `--alpha`.
+# Exit with 1 if any regression is found, so nightly runs can gate on it.
+import sys
+import json
+import math
+import argparse
+import os
+
+
+def load(path):
+    records = {}
+    with open(path) as f:
+        for line in f:
+            if not line.strip():
+                continue
+            r = json.loads(line)
+            key = (os.path.basename(r["binary"]), r["mode"], r["dtype"], r["device"], r["ranks"],
+                   r["commands"], tuple(sorted(r["env"].items())))
+            records[key] = r
+    return records
+
+
+def median(samples):
+    s = sorted(samples)
+    n = len(s)
+    return (s[n // 2] + s[(n - 1) // 2]) / 2
+
+
+def mann_whitney_greater(current, baseline):
+    """p-value of `current` being stochastically greater (slower) than `baseline`.
+    Normal approximation with tie correction, good enough for the usual 10 repetitions"""
+    n1, n2 = len(current), len(baseline)
+    if n1 == 0 or n2 == 0:
+        return 1.
+    values = sorted([(v, 0) for v in current] + [(v, 1) for v in baseline])
+    ranks = [0.] * len(values)
+    ties = 0.
+    i = 0
+    while i < len(values):
+        j = i
+        while j + 1 < len(values) and values[j + 1][0] == values[i][0]:
+            j += 1
+        for k in range(i, j + 1):
+            ranks[k] = (i + j) / 2 + 1
+        t = j - i + 1
+        ties += t**3 - t
+        i = j + 1
+    r1 = sum(r for r, (_, g) in zip(ranks, values) if g == 0)
+    u1 = r1 - n1 * (n1 + 1) / 2
+    n = n1 + n2
+    sigma = math.sqrt(n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1))))
+    if sigma == 0:
+        return 1.
+    z = (u1 - n1 * n2 / 2 - 0.5) / sigma
+    return 0.5 * math.erfc(z / math.sqrt(2))
+
+
+def times(r):
+    """(name, samples) of every time of a record"""
+    yield "serial", r["serial"]["samples_us"]
+    for i, c in enumerate(r["serial"]["commands"]):
+        yield f"serial {i} ({c['command']})", c["samples_us"]
+    if "concurent" in r:
+        yield "//", r["concurent"]["samples_us"]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="minimum relative slowdown of the median [default: 0.05]")
+    parser.add_argument("--alpha", type=float, default=0.01,
+                        help="significance level of the test [default: 0.01]")
+    args = parser.parse_args()
+
+    baseline, current = load(args.baseline), load(args.current)
+    n_regressions = 0
+    for key, r in current.items():
+        name = f"{key[1]} | {key[5]} | {key[2]}"
+        if key not in baseline:
+            print(f"NEW        {name}")
+            continue
+        b = dict(times(baseline[key]))
+        for time_name, samples in times(r):
+            if time_name not in b or not samples or not b[time_name]:
+                continue
+            if median(b[time_name]) == 0:
+                # Sub-microsecond baseline, no ratio
+                print(f"{'SKIPPED':10} {name} | {time_name}: 0us baseline median")
+                continue
+            ratio = median(samples) / median(b[time_name])
+            p = mann_whitney_greater(samples, b[time_name])
+            regression = ratio > 1 + args.threshold and p < args.alpha
+            n_regressions += regression
+            print(f"{'REGRESSION' if regression else 'OK':10} {name} | {time_name}: "
+                  f"{median(b[time_name]):.0f}us -> {median(samples):.0f}us "
+                  f"({100 * (ratio - 1):+.1f}%, p={p:.3g})")
+    for key in baseline.keys() - current.keys():
+        print(f"MISSING    {key[1]} | {key[5]} | {key[2]}")
+
+    print(f"# {n_regressions} regression(s)")
+    sys.exit(1 if n_regressions else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,149 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Allocation policy of the 'M' (malloc) buffers
+struct host_policy_t {
+  int numa_node = -1;              // -1: no binding
+  std::string huge_pages = "none"; // none | thp | explicit
+  bool parallel_first_touch = false;
+  bool pin = false; // Registered to the runtime by the backend
+};
+
+extern host_policy_t host_policy;
+
+inline std::string to_string(const host_policy_t &policy) {
+  std::string s = "numa_node: " + std::to_string(policy.numa_node);
+  s += ", huge_pages: " + policy.huge_pages;
+  s += ", first_touch: " + std::string(policy.parallel_first_touch ? "parallel" : "serial");
+  s += ", pin: " + std::string(policy.pin ? "yes" : "no");
+  return s;
+}
+
+// Explicit huge pages are 2MB on x86
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+inline size_t host_alloc_size(size_t bytes, const host_policy_t &policy) {
+  const size_t page = (policy.huge_pages == "explicit") ? HUGE_PAGE_SIZE : sysconf(_SC_PAGESIZE);
+  return std::max<size_t>(1, (bytes + page - 1) / page) * page;
+}
+
+// "0-3,8,10-11" (sysfs cpulist and node list) -> {0, 1, 2, 3, 8, 10, 11}. Empty if unreadable
+inline std::vector<int> read_list(const std::string &path) {
+  std::ifstream in(path);
+  std::vector<int> values;
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    int first, last;
+    char dash;
+    std::stringstream ss(range);
+    if (!(ss >> first))
+      continue;
+    last = (ss >> dash >> last) ? last : first;
+    for (int v = first; v <= last; v++)
+      values.push_back(v);
+  }
+  return values;
+}
+
+// CPUs the process may run on (its cpuset), restricted to `numa_node` unless it is -1 or none of
+// them is in the node
+inline std::vector<int> first_touch_cpus(int numa_node) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  sched_getaffinity(0, sizeof(set), &set);
+  std::vector<int> allowed;
+  for (int c = 0; c < CPU_SETSIZE; c++)
+    if (CPU_ISSET(c, &set))
+      allowed.push_back(c);
+  if (numa_node < 0)
+    return allowed;
+  std::vector<int> cpus;
+  for (auto c : read_list("/sys/devices/system/node/node" + std::to_string(numa_node) + "/cpulist"))
+    if (CPU_ISSET(c, &set))
+      cpus.push_back(c);
+  return cpus.empty() ? allowed : cpus;
+}
+
+// `MPOL_*` memory policy of [ptr, ptr + size) over `nodes`.
+// We call mbind directly to not depend on libnuma
+inline bool mbind_nodes(void *ptr, size_t size, int mode, const std::vector<int> &nodes) {
+  const unsigned MPOL_MF_STRICT_ = 1 << 0;
+  const size_t bits = 8 * sizeof(unsigned long);
+  std::vector<unsigned long> nodemask(*std::max_element(nodes.begin(), nodes.end()) / bits + 1);
+  for (auto node : nodes)
+    nodemask[node / bits] |= 1UL << (node % bits);
+  return syscall(SYS_mbind, ptr, size, mode, nodemask.data(), bits * nodemask.size() + 1,
+                 MPOL_MF_STRICT_) == 0;
+}
+
+// Pages are placed by the first touch, so the policy is set before it: bound to `numa_node`, or
+// interleaved over the nodes when several threads touch (their placement would depend on the
+// scheduler). The touching threads are pinned to the CPUs of the node (else of the process)
+inline void *host_alloc(size_t bytes, const host_policy_t &policy) {
+  const size_t size = host_alloc_size(bytes, policy);
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  if (policy.huge_pages == "explicit")
+    flags |= MAP_HUGETLB;
+  void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (ptr == MAP_FAILED) {
+    std::cerr << "ERROR: mmap of " << size << " bytes failed (" << std::strerror(errno)
+              << "). Are enough huge pages reserved (/proc/sys/vm/nr_hugepages)?" << std::endl;
+    std::exit(1);
+  }
+  if (policy.huge_pages == "thp")
+    madvise(ptr, size, MADV_HUGEPAGE);
+
+  const int MPOL_BIND_ = 2, MPOL_INTERLEAVE_ = 3;
+  if (policy.numa_node >= 0) {
+    if (!mbind_nodes(ptr, size, MPOL_BIND_, {policy.numa_node}))
+      std::cerr << "WARNING: mbind to NUMA node " << policy.numa_node
+                << " failed: " << std::strerror(errno) << std::endl;
+  } else if (policy.parallel_first_touch) {
+    const auto nodes = read_list("/sys/devices/system/node/online");
+    if (nodes.size() > 1 && !mbind_nodes(ptr, size, MPOL_INTERLEAVE_, nodes))
+      std::cerr << "WARNING: mbind interleaved over the NUMA nodes failed: "
+                << std::strerror(errno) << std::endl;
+  }
+
+  // First-touch, by one thread or by one thread per CPU (each touching a contiguous chunk)
+  const auto cpus = first_touch_cpus(policy.numa_node);
+  const size_t n_threads = policy.parallel_first_touch ? std::max<size_t>(1, cpus.size()) : 1;
+  const size_t chunk = (size + n_threads - 1) / n_threads;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < n_threads; t++)
+    threads.emplace_back([=]() {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      if (policy.parallel_first_touch && !cpus.empty())
+        CPU_SET(cpus[t], &set);
+      else
+        for (auto c : cpus)
+          CPU_SET(c, &set);
+      if (!cpus.empty())
+        sched_setaffinity(0, sizeof(set), &set); // The calling thread only
+      const size_t begin = std::min(size, t * chunk);
+      const size_t end = std::min(size, begin + chunk);
+      std::memset(static_cast<char *>(ptr) + begin, 0, end - begin);
+    });
+  for (auto &thread : threads)
+    thread.join();
+
+  return ptr;
+}
+
+inline void host_free(void *ptr, size_t bytes, const host_policy_t &policy) {
+  munmap(ptr, host_alloc_size(bytes, policy));
+}
@@ -1,4 +1,7 @@
 #include "bench.hpp"
+#include "host_alloc.hpp"
+#include "mpi_command.hpp"
+#include "results.hpp"
 #include <algorithm>
 #include <iomanip>
 #include <iostream>
@@ -11,11 +14,15 @@
 
 #define TOL_SPEEDUP 0.3
 
+host_policy_t host_policy;
+
+// "A2B" -> "AB", the shape of a strided copy ("A2B:2d(...)") is kept as is
 std::string sanitize_command(std::string command) {
-  std::string command_sanitized(command);
+  const auto pos = std::min(command.find(':'), command.size());
+  std::string command_sanitized(command.substr(0, pos));
   command_sanitized.erase(std::remove(command_sanitized.begin(), command_sanitized.end(), '2'),
                           command_sanitized.end());
-  return command_sanitized;
+  return command_sanitized + command.substr(pos);
 }
 
 template <class T>
@@ -23,10 +30,12 @@ std::string time_info(std::vector<std::string> commands, long time,
                       std::unordered_map<std::string, size_t> &commands_parameters,
                       float min_bandwidth = -1, int *pci_erno = NULL) {
 
-  unsigned bytes = 0;
-  for (const auto &command : commands)
-    if (command != "C")
-      bytes += commands_parameters["globalsize_" + command] * sizeof(T);
+  size_t bytes = 0;
+  size_t flop = 0;
+  for (const auto &command : commands) {
+    bytes += command_bytes(command, sizeof(T), commands_parameters);
+    flop += command_flop(command, commands_parameters);
+  }
 
   std::stringstream sout;
   sout << time << "us";
@@ -40,6 +49,13 @@ std::string time_info(std::vector<std::string> commands, long time,
         *pci_erno = 0;
     }
   }
+  if (flop)
+    sout << " (" << (1E-3) * flop / time << " GFlop/s)";
+  if (flop && bytes)
+    sout << " (" << (1. * flop) / bytes << " Flop/Byte)";
+  if (std::any_of(commands.begin(), commands.end(),
+                  [](const auto &c) { return c.find('M') != std::string::npos; }))
+    sout << " [M " << to_string(host_policy) << "]";
   return sout.str();
 }
 
@@ -51,10 +67,20 @@ void print_help_and_exit(std::string binname, std::string msg) {
       "\n"
       "                [--enable_profiling]\n"
       "                [--tripcount_C <tripcount>]\n"
-      "                [--globalsize_{C,A2B} <global_size>]\n"
+      "                [--ilp_C <n_chains>] [--vector_C <n_lanes>] [--precision_C <precision>]\n"
+      "                [--dtype <dtypes>]\n"
+      "                [--intensity_T <n_fma>] [--advice <advice>]\n"
+      "                [--globalsize_{C,T,R,X,A2B} <global_size>]\n"
       "                [--queues <n_queues>]\n"
       "                [--repetitions <n_repetions>]\n"
+      "                [--submissions <n_submissions>]\n"
+      "                [--host_threads <n_host_threads>]\n"
+      "                [--sweep <max_queues>]\n"
+      "                [--M_numa_node <node>] [--M_huge_pages <policy>]\n"
+      "                [--M_first_touch <policy>] [--M_pin]\n"
+      "                [--device <selector>] [--devices <policy>]\n"
       "		       [--min_bandwidth <min_bandwidth>\n"
+      "                [--output <file>]\n"
       "                [--commands COMMANDS..]\n"
       "\n"
       "Options:\n"
@@ -62,7 +88,19 @@ void print_help_and_exit(std::string binname, std::string msg) {
       "perform 64*C_tripcount FMA\n"
       "                              '-1' will auto-tune this parameter so "
       "each commands take similar time\n"
-      "--globalsize_{C,A2B}        [default: -1]. Work-group size of the "
+      "--ilp_C                     [default: 1]. Independent FMA chains per work-item "
+      "[possible values: 1, 2, 4, 8]\n"
+      "--vector_C                  [default: 1]. Vector lanes per chain (sycl::vec or omp simd) "
+      "[possible values: 1, 2, 4, 8, 16]\n"
+      "--precision_C               [default: dtype]. [possible values: float, double, half, int8]\n"
+      "--dtype                     [default: float]. Comma separated element types of the buffers "
+      "[possible values: float, double, half, int8]\n"
+      "                              each one is benchmarked (and auto-tuned) in turn, then "
+      "summarized\n"
+      "--intensity_T               [default: 0]. Extra FMA per element of the triad, from "
+      "memory-bound (0)\n"
+      "                              to compute-bound\n"
+      "--globalsize_{C,T,R,X,A2B}  [default: -1]. Work-group size of the "
       "commands\n"
       "                             '-1' will auto-tune this parameter so each "
       "commands take similar time\n"
@@ -72,36 +110,116 @@ void print_help_and_exit(std::string binname, std::string msg) {
       "--queues                    [default: -1]. Number of queues used to run "
       "COMMANDS\n"
       "                              '-1' mean automatic selection:\n"
-      "                              - if `host_threads | in_order`, one "
-      "threads/queues per COMMAND\n"
+      "                              - if `host_threads | in_order | tasks | interop`, one "
+      "threads/queues/chains per COMMAND\n"
       "                              - else one queue\n"
       "--repetitions               [default: 10]. Number of repetions for each "
       "measuremnts\n"
       "---min_bandwidth            [default: -1]. Minimun bandwidith require for the test to pass\n"
       "				     '-1' mean no minimun\n"
-      "COMMAND                     [possible values: C, A2B]\n"
+      "--output                    [default: none]. Append one record per COMMANDS (and dtype) to "
+      "<file>:\n"
+      "                              a JSON line if it ends with .json or .jsonl, else a CSV row\n"
+      "                              (environment, parameters, times, bandwidths, speedups, "
+      "samples)\n"
+      "--submissions               [default: 0]. Measure the submission overhead instead of the "
+      "concurrency:\n"
+      "                              each COMMAND is submitted <n_submissions> times as an empty "
+      "kernel (C)\n"
+      "                              or a single element copy (A2B). Not in graph mode\n"
+      "--host_threads              [default: 1]. Number of host threads submitting when "
+      "'--submissions' is used\n"
+      "--sweep                     [default: 0]. Run COMMANDS replicated 1, 2, 4, ... "
+      "<max_queues> times\n"
+      "                              on as many queues/threads and report the scaling,\n"
+      "                              <max_queues> being a power of two\n"
+      "--M_numa_node               [default: -1]. NUMA node the 'M' buffers are bound to\n"
+      "                              '-1' mean no binding\n"
+      "--M_huge_pages              [default: none]. Pages of the 'M' buffers "
+      "[possible values: none, thp, explicit]\n"
+      "                              thp: transparent huge pages (madvise)\n"
+      "                              explicit: MAP_HUGETLB, need reserved huge pages\n"
+      "--M_first_touch             [default: serial]. Threads first-touching the 'M' buffers "
+      "[possible values: serial, parallel]\n"
+      "                              parallel: one pinned thread per CPU, interleaved pages "
+      "without --M_numa_node\n"
+      "--M_pin                     Register (pin) the 'M' buffers to the runtime\n"
+      "--device                    [default: gpu]. Device used [possible values: cpu, gpu, <index>, "
+      "<filter>]\n"
+      "                              <index>: in the list of all the devices\n"
+      "                              <filter>: first device whose '<platform>: <name>' contains it "
+      "(SYCL)\n"
+      "                              host threads are pinned (one per core) when it may be a CPU\n"
+      "--devices                   [default: single]. Devices the COMMANDS are spread over (SYCL) "
+      "[possible values: single, numa, all]\n"
+      "                              numa: sub-devices of the device (tiles, sockets)\n"
+      "                              all: every device of the platform\n"
+      "                              the aggregate is compared against the single device\n"
+      "--advice                    [default: 0]. Advice (device specific value) given to mem_advise "
+      "by 'advise'\n"
+      "COMMAND                     [possible values: C, T, R, X, A2B, A2B:2d(rows,cols,pitch), "
+      "fill, memset, N,\n"
+      "                              prefetch, advise, touch_device, touch_host]\n"
       "                              C:  Compute kernel\n"
+      "                              T:  STREAM triad kernel (a = b + s * c)\n"
+      "                              R:  Sum reduction kernel\n"
+      "                              X:  7-point stencil kernel\n"
       "                              A2B: Memcopy from A to B\n"
       "                              Where A,B can be:\n"
       "                                M: Malloc allocated memory\n"
       "                                D: sycl::device allocated memory\n"
       "                                H: sycl::host allocated memory\n"
-      "                                S: sycl::shared allocated memory\n";
+      "                                S: sycl::shared allocated memory (SYCL)\n"
+      "                              A2B:2d(rows,cols,pitch): Strided copy of <rows> rows of <cols> "
+      "elements,\n"
+      "                                <pitch> elements apart (same pitch for A and B), compared\n"
+      "                                against a contiguous A2B of the same bytes\n"
+      "                              fill: Fill a device buffer with a value\n"
+      "                              memset: Set the bytes of a device buffer to zero\n"
+      "                              N: Isend/Irecv of a host buffer with the partner rank "
+      "(rank ^ 1),\n"
+      "                                 need a build with -DUSE_MPI, times are the max over the "
+      "ranks\n"
+      "                              prefetch: Prefetch a shared buffer to the device (SYCL)\n"
+      "                              advise: mem_advise a shared buffer, then touch it on the "
+      "device (SYCL)\n"
+      "                              touch_device: Read and write a shared buffer on the device\n"
+      "                              touch_host: Read and write a shared buffer on the host\n"
+      "                              The shared buffers are moved back before each repetition\n";
   std::cout << help << std::endl;
+  mpi_command_finalize();
   std::exit(1);
 }
 
-size_t get_default_command_parameter(std::string command, size_t num_command,
+long parse_precision(const std::string &name) {
+  for (long precision : {PRECISION_FLOAT, PRECISION_DOUBLE, PRECISION_HALF, PRECISION_INT8})
+    if (name == precision_name(precision))
+      return precision;
+  return -1;
+}
+
+size_t get_default_command_parameter(std::string command, size_t sizeof_T,
                                      std::unordered_map<std::string, long> &commands) {
   if (command.rfind("globalsize_C", 0) == 0)
     return 1;
   if (command.rfind("tripcount_C", 0) == 0)
     return 40000;
+  if (command == "ilp_C" || command == "vector_C")
+    return 1;
+  if (command == "precision_C")
+    return PRECISION_FLOAT;
+  if (command == "intensity_T")
+    return 0;
+  if (command == "devices")
+    return DEVICES_SINGLE;
+  if (command == "advice")
+    return 0;
   if (command.rfind("globalsize_", 0) == 0) {
     if (commands["globalsize_default_memory"] != -1)
       return commands["globalsize_default_memory"];
     const auto max_mem_alloc_command = 1e9; //~One gigabyte
-    return max_mem_alloc_command / sizeof(float);
+    // Split between the arrays of the memory-bound kernels
+    return max_mem_alloc_command / sizeof_T / command_arrays(command.substr(11));
   }
   return 0;
 }
@@ -119,13 +237,26 @@ int main(int argc, char *argv[]) {
   //                      _|                   _|
   //
   std::unordered_map<std::string, long> commands_parameters_cli = {
-      {"globalsize_C", -1}, {"tripcount_C", -1}, {"globalsize_default_memory", -1}};
+      {"globalsize_C", -1}, {"tripcount_C", -1}, {"globalsize_default_memory", -1},
+      {"ilp_C", -1},        {"vector_C", -1},    {"precision_C", -1},
+      {"intensity_T", -1},  {"devices", -1},     {"advice", -1}};
   bool enable_profiling = false;
   bool verbose = false;
 
   int n_queues = -1;
   int n_repetitions = 10;
   float min_bandwidth = -1;
+  size_t n_submissions = 0;
+  int n_host_threads = 1;
+  int max_queues_sweep = 0;
+  std::string device_selector = "gpu";
+  std::vector<long> dtypes = {PRECISION_FLOAT};
+  std::string output_path;
+
+  // Every rank runs the same COMMANDS, only the first one reports
+  const int mpi_rank = mpi_command_init(&argc, &argv);
+  if (mpi_rank != 0)
+    std::cout.setstate(std::ios::failbit);
 
   std::vector<std::string> argl(argv + 1, argv + argc);
   if (argl.empty())
@@ -160,6 +291,53 @@ int main(int argc, char *argv[]) {
       } else {
         print_help_and_exit(argv[0], "Need to specify an value for '--queues'");
       }
+    } else if (s == "--submissions") {
+      i++;
+      if (i < argl.size()) {
+        n_submissions = std::stoul(argl[i]);
+      } else {
+        print_help_and_exit(argv[0], "Need to specify an value for '--submissions'");
+      }
+    } else if (s == "--host_threads") {
+      i++;
+      if (i < argl.size()) {
+        n_host_threads = std::stoi(argl[i]);
+      } else {
+        print_help_and_exit(argv[0], "Need to specify an value for '--host_threads'");
+      }
+    } else if (s == "--sweep") {
+      i++;
+      if (i < argl.size()) {
+        max_queues_sweep = std::stoi(argl[i]);
+        // The points are powers of two, the buffers being acquired for `max_queues`
+        if (max_queues_sweep < 0 || (max_queues_sweep & (max_queues_sweep - 1)))
+          print_help_and_exit(argv[0], "Need to specify a power of two for '--sweep'");
+      } else {
+        print_help_and_exit(argv[0], "Need to specify an value for '--sweep'");
+      }
+    } else if (s == "--M_numa_node") {
+      i++;
+      if (i < argl.size()) {
+        host_policy.numa_node = std::stoi(argl[i]);
+      } else {
+        print_help_and_exit(argv[0], "Need to specify an value for '--M_numa_node'");
+      }
+    } else if (s == "--M_huge_pages") {
+      i++;
+      if (i < argl.size() && (argl[i] == "none" || argl[i] == "thp" || argl[i] == "explicit")) {
+        host_policy.huge_pages = argl[i];
+      } else {
+        print_help_and_exit(argv[0], "Need to specify (none | thp | explicit) for '--M_huge_pages'");
+      }
+    } else if (s == "--M_first_touch") {
+      i++;
+      if (i < argl.size() && (argl[i] == "serial" || argl[i] == "parallel")) {
+        host_policy.parallel_first_touch = (argl[i] == "parallel");
+      } else {
+        print_help_and_exit(argv[0], "Need to specify (serial | parallel) for '--M_first_touch'");
+      }
+    } else if (s == "--M_pin") {
+      host_policy.pin = true;
     } else if (s == "--min_bandwidth") {
       i++;
       if (i < argl.size()) {
@@ -167,6 +345,73 @@ int main(int argc, char *argv[]) {
       } else {
         print_help_and_exit(argv[0], "Need to specify an value for '--min_bandwidth'");
       }
+    } else if (s == "--ilp_C" || s == "--vector_C") {
+      i++;
+      const std::set<std::string> allowed =
+          (s == "--ilp_C") ? std::set<std::string>{"1", "2", "4", "8"}
+                           : std::set<std::string>{"1", "2", "4", "8", "16"};
+      if (i < argl.size() && allowed.count(argl[i])) {
+        commands_parameters_cli[s.substr(2)] = std::stol(argl[i]);
+      } else {
+        print_help_and_exit(argv[0], "Need to specify a power of two for " + s);
+      }
+    } else if (s == "--precision_C") {
+      i++;
+      const auto precision = (i < argl.size()) ? parse_precision(argl[i]) : -1;
+      if (precision != -1) {
+        commands_parameters_cli["precision_C"] = precision;
+      } else {
+        print_help_and_exit(argv[0],
+                            "Need to specify (float | double | half | int8) for '--precision_C'");
+      }
+    } else if (s == "--dtype") {
+      i++;
+      dtypes.clear();
+      std::stringstream ss(i < argl.size() ? argl[i] : "");
+      for (std::string name; std::getline(ss, name, ',');)
+        dtypes.push_back(parse_precision(name));
+      if (dtypes.empty() || std::count(dtypes.begin(), dtypes.end(), -1))
+        print_help_and_exit(argv[0], "Need to specify a list of (float | double | half | int8) "
+                                     "for '--dtype'");
+    } else if (s == "--output") {
+      i++;
+      if (i < argl.size()) {
+        output_path = argl[i];
+      } else {
+        print_help_and_exit(argv[0], "Need to specify a file for '--output'");
+      }
+    } else if (s == "--device") {
+      i++;
+      if (i < argl.size()) {
+        device_selector = argl[i];
+      } else {
+        print_help_and_exit(argv[0], "Need to specify an value for '--device'");
+      }
+    } else if (s == "--devices") {
+      i++;
+      if (i < argl.size() && argl[i] == "single") {
+        commands_parameters_cli["devices"] = DEVICES_SINGLE;
+      } else if (i < argl.size() && argl[i] == "numa") {
+        commands_parameters_cli["devices"] = DEVICES_NUMA;
+      } else if (i < argl.size() && argl[i] == "all") {
+        commands_parameters_cli["devices"] = DEVICES_ALL;
+      } else {
+        print_help_and_exit(argv[0], "Need to specify (single | numa | all) for '--devices'");
+      }
+    } else if (s == "--advice") {
+      i++;
+      if (i < argl.size()) {
+        commands_parameters_cli["advice"] = std::stol(argl[i]);
+      } else {
+        print_help_and_exit(argv[0], "Need to specify an value for '--advice'");
+      }
+    } else if (s == "--intensity_T") {
+      i++;
+      if (i < argl.size()) {
+        commands_parameters_cli["intensity_T"] = std::stol(argl[i]);
+      } else {
+        print_help_and_exit(argv[0], "Need to specify an value for '--intensity_T'");
+      }
     } else if ((s.rfind("--tripcount_") == 0) || (s.rfind("--globalsize_", 0) == 0)) {
       i++;
       if (i < argl.size()) {
@@ -183,22 +428,76 @@ int main(int argc, char *argv[]) {
     } else if (s.rfind("-", 0) == 0) {
       print_help_and_exit(argv[0], "Unsupported option: '" + s + "'");
     } else {
-      static std::vector<std::string> command_supported = {"C", "M", "D", "H"};
+      // Kernels are one letter, migrations and fills one word, copies are two memory kinds
+      static std::vector<std::string> command_supported = {"M", "D", "H", "S"};
       const auto sc = sanitize_command(s);
-      for (auto c : sc) {
-        if (std::find(command_supported.begin(), command_supported.end(), std::string{c}) ==
-                command_supported.end() ||
-            sc == "HM" || sc == "MH")
-          print_help_and_exit(argv[0], "Unsupported value for COMMAND: " + s);
+#ifndef USE_MPI
+      if (is_network_command(sc))
+        print_help_and_exit(argv[0], "'N' needs a build with -DUSE_MPI");
+#endif
+      if (!is_kernel_command(sc) && !is_migration_command(sc) && !is_fill_command(sc) &&
+          !is_network_command(sc)) {
+        const auto kinds = command_kinds(sc);
+        for (auto c : kinds) {
+          if (std::find(command_supported.begin(), command_supported.end(), std::string{c}) ==
+                  command_supported.end() ||
+              kinds == "HM" || kinds == "MH")
+            print_help_and_exit(argv[0], "Unsupported value for COMMAND: " + s);
+        }
+        // The size of a strided copy is its shape, it is not auto-tuned
+        if (kinds != sc) {
+          copy2d_t copy2d;
+          if (!parse_copy2d(sc, copy2d))
+            print_help_and_exit(argv[0], "Need to specify A2B:2d(<rows>,<cols>,<pitch>) with "
+                                         "<pitch> >= <cols> > 0 for COMMAND: " + s);
+          commands_parameters_cli["globalsize_" + sc] = copy2d.rows * copy2d.cols;
+        }
       }
+      validate_command(argv[0], sc);
       commands.push_back(sc);
     }
   }
 
   if (l_commands.empty())
-    print_help_and_exit(argv[0], "Need to specify --COMMANDS (C,M2D,D2M,H2D,D2H)");
+    print_help_and_exit(argv[0], "Need to specify --COMMANDS (C,T,R,X,M2D,D2M,H2D,D2H)");
 
   commands = l_commands[0];
+  const auto device_name = select_device(argv[0], device_selector);
+  std::cout << "# Device: " << device_name << std::endl;
+  // Submission overhead: fixed cost of submitting one command, no concurrency analysis
+  if (n_submissions) {
+    // The flood is submitted to plain queues, nothing would be recorded
+    if (mode == "graph")
+      print_help_and_exit(argv[0], "'--submissions' does not support the graph mode");
+    std::set<std::string> commands_uniq;
+    for (const auto &commands : l_commands)
+      commands_uniq.insert(commands.begin(), commands.end());
+
+    for (const auto dtype : dtypes)
+      with_dtype(dtype, [&](auto zero) {
+        using T = decltype(zero);
+        for (const auto &command : commands_uniq) {
+          std::cout << "# Submission Overhead | " << mode << " | " << command
+                    << " | dtype: " << precision_name(dtype) << " | queues: "
+                    << submission_queues(mode, n_queues, n_host_threads)
+                    << " | host_threads: " << n_host_threads
+                    << " | submissions: " << n_submissions << std::endl;
+          // Strided copies keep their API, with a 1x1 shape to move one element as the others
+          copy2d_t copy2d;
+          const auto submitted =
+              parse_copy2d(command, copy2d) ? command_kinds(command) + ":2d(1,1,1)" : command;
+          const auto [submission_time, total_time] = bench_submission<T>(
+              mode, submitted, n_submissions, n_queues, n_host_threads, n_repetitions, verbose);
+          std::cout << "Minimum Measured Submission Time: " << submission_time << "us ("
+                    << (1. * submission_time) / n_submissions << " us/submission)" << std::endl;
+          std::cout << "Minimum Measured Total Time: " << total_time << "us ("
+                    << (1. * n_submissions) / total_time << " Msubmissions/s)" << std::endl;
+        }
+      });
+    release_arena();
+    mpi_command_finalize();
+    exit(0);
+  }
   //    _       _                 _
   //   | \  _ _|_ _.     | _|_   |_) _. ._ _. ._ _   _ _|_  _  ._   \  / _. |
   //   |_/ (/_ | (_| |_| |  |_   |  (_| | (_| | | | (/_ |_ (/_ |     \/ (_| |
@@ -208,115 +507,261 @@ int main(int argc, char *argv[]) {
     for (const auto &command : commands)
       commands_parameters_cli.try_emplace("globalsize_" + command, -1);
 
-  std::unordered_map<std::string, size_t> commands_parameters;
-  for (const auto &[k, v] : commands_parameters_cli)
-    commands_parameters[k] =
-        (v == -1) ? get_default_command_parameter(k, commands.size(), commands_parameters_cli) : v;
+  // One pass per element type, each with its own defaults and autotuning
+  struct dtype_row_t {
+    std::string dtype, commands;
+    long serial_time, concurent_time;
+    std::string concurent_info;
+    double speedup;
+  };
+  std::vector<dtype_row_t> dtype_table;
+  int exit_code = 0;
+  for (const auto dtype : dtypes)
+    with_dtype(dtype, [&](auto zero) {
+      using T = decltype(zero);
+      std::cout << "# dtype: " << precision_name(dtype) << " (" << sizeof(T) << " Bytes)"
+                << std::endl;
+      std::unordered_map<std::string, size_t> commands_parameters;
+      for (const auto &[k, v] : commands_parameters_cli)
+        commands_parameters[k] =
+            (v == -1) ? get_default_command_parameter(k, sizeof(T), commands_parameters_cli) : v;
+      // The compute kernel follows the element type, unless its precision is given
+      if (commands_parameters_cli["precision_C"] == -1)
+        commands_parameters["precision_C"] = dtype;
 
-  std::set<std::string> commands_uniq;
-  for (const auto &commands : l_commands)
-    commands_uniq.insert(commands.begin(), commands.end());
-  //                                     __
-  //    /\     _|_  _ _|_     ._   _    (_   _  ._ o  _. |
-  //   /--\ |_| |_ (_) |_ |_| | | (/_   __) (/_ |  | (_| |
-  //
-  // We want each command to take the same time. We have only one parameter
-  // (kernel_tripcount)
-  // In first approximation, all our commands are linear in time
-  bool need_auto_tunne = false;
-  for (const auto k : commands_uniq) {
-    const auto name_parameter = commands_to_parameters_tunned(k);
-    need_auto_tunne |= (commands_parameters_cli[name_parameter] == -1);
-  }
+      std::set<std::string> commands_uniq;
+      for (const auto &commands : l_commands)
+        commands_uniq.insert(commands.begin(), commands.end());
 
-  if (need_auto_tunne && (commands_uniq.size() != 1)) {
-    std::cout << "# Performing Autotuning to Balance Commands Times" << std::endl;
-    // Get the baseline. We assume everything is linear, run the max value
-    std::vector<std::string> commands_uniq_vec(commands_uniq.begin(), commands_uniq.end());
-    auto [_, serial_commands_times] =
-        bench<float>("serial", commands_uniq_vec, commands_parameters, enable_profiling, n_queues,
-                     n_repetitions, verbose);
-
-    // Take the min-time of the max value
-    long min_time = std::numeric_limits<long>::max();
-    for (int i = 0; i < commands_uniq_vec.size(); i++) {
-      if (commands_uniq_vec[i] == "C")
-        continue;
-      min_time = std::min(serial_commands_times[i], min_time);
-    }
-    // Just need to apply the regression now
-    for (int i = 0; i < commands_uniq_vec.size(); i++) {
-      const auto name_command = commands_uniq_vec[i];
-      const auto name_parameter = commands_to_parameters_tunned(name_command);
-      if (commands_parameters_cli[name_parameter] == -1) {
-        // Todo check if new_parameter >= max possible values
-        long new_parameter =
-            (1. * min_time) / serial_commands_times[i] * commands_parameters[name_parameter];
-        commands_parameters[name_parameter] = new_parameter;
+      // Autotuning only shrinks the sizes, so those buffers will serve every `bench` call
+      const auto arena_bytes = reserve_arena<T>(l_commands, commands_parameters);
+      std::cout << "# Buffers Arena Reserved: " << (1E-9) * arena_bytes << " GBytes" << std::endl;
+      //                                     __
+      //    /\     _|_  _ _|_     ._   _    (_   _  ._ o  _. |
+      //   /--\ |_| |_ (_) |_ |_| | | (/_   __) (/_ |  | (_| |
+      //
+      // We want each command to take the same time. We have only one parameter
+      // (kernel_tripcount)
+      // In first approximation, all our commands are linear in time
+      bool need_auto_tunne = false;
+      for (const auto k : commands_uniq) {
+        const auto name_parameter = commands_to_parameters_tunned(k);
+        need_auto_tunne |= (commands_parameters_cli[name_parameter] == -1);
       }
-    }
-  }
 
-  std::cout << "Parameters used:" << std::endl;
-  for (const auto k : commands_uniq) {
-    const auto name_parameter = commands_to_parameters_tunned(k);
-    std::cout << "  " << name_parameter << ": " << commands_parameters[name_parameter] << std::endl;
-    if (k == "C")
-      std::cout << "  "
-                << "globalsize_C"
-                << ": " << commands_parameters["globalsize_C"] << std::endl;
-  }
+      if (need_auto_tunne && (commands_uniq.size() != 1)) {
+        std::cout << "# Performing Autotuning to Balance Commands Times" << std::endl;
+        // Get the baseline. We assume everything is linear, run the max value
+        std::vector<std::string> commands_uniq_vec(commands_uniq.begin(), commands_uniq.end());
+        const auto serial_commands_times =
+            bench<T>("serial", commands_uniq_vec, commands_parameters, enable_profiling, n_queues,
+                     n_repetitions, verbose)
+                .commands_times;
 
-  int exit_code = 0;
-  for (auto &commands : l_commands) {
-
-    std::stringstream command_str;
-    command_str << mode << " | ";
-    for (const auto &c : commands)
-      command_str << c << " ";
-    std::cout << "# " << command_str.str() << "| Starting Benchmarking..." << std::endl;
-
-    // Serial Reference
-
-    const auto &[serial_total_time, serial_commands_times] =
-        bench<float>("serial", commands, commands_parameters, enable_profiling, n_queues,
-                     n_repetitions, verbose);
-    std::cout << "Minimum Measured Total Time Serial: " << serial_total_time << "us" << std::endl;
-    for (size_t i = 0; i < commands.size(); i++) {
-      std::cout << "  Minimum Time Command " << i << " (" << std::setw(3) << commands[i] << "): "
-                << time_info<float>({commands[i]}, serial_commands_times[i], commands_parameters)
-                << std::endl;
-    }
-    const double max_speedup =
-        (1. * serial_total_time) /
-        *std::max_element(serial_commands_times.begin(), serial_commands_times.end());
-    std::cout << "Maximum Theoretical Speedup: " << max_speedup << "x" << std::endl;
-
-    if (commands.size() >= 1 && max_speedup <= 1.50)
-      std::cerr << "  WARNING: Large Unbalance Between Commands" << std::endl;
-
-    // Run in //
-    const auto &[concurent_total_time, _] = bench<float>(
-        mode, commands, commands_parameters, enable_profiling, n_queues, n_repetitions, verbose);
-
-    // Analysis
-    int pci_erno = 0;
-    std::cout << "Minimum Measured Total Time //: "
-              << time_info<float>(commands, concurent_total_time, commands_parameters, 
-				  min_bandwidth, &pci_erno)
-              << std::endl;
-    const double speedup = (1. * serial_total_time) / concurent_total_time;
-    std::cout << "Speedup Relative to Serial: " << speedup << "x" << std::endl;
-    std::cout << "## " << command_str.str();
-    if (pci_erno != 0) {
-      std::cout << "| FAILURE: Minimun Bandwish not reached" << std::endl;
-      exit_code = 1;
-    } else if (max_speedup >= ((1. + TOL_SPEEDUP) * speedup)) {
-      std::cout << "| FAILURE: Far from Theoretical Speedup" << std::endl;
-      exit_code = 1;
-    } else {
-      std::cout << "| SUCCESS: Close from Theoretical Speedup" << std::endl;
-    }
+        // Take the min-time of the max value
+        long min_time = std::numeric_limits<long>::max();
+        for (int i = 0; i < commands_uniq_vec.size(); i++) {
+          if (commands_uniq_vec[i] == "C")
+            continue;
+          min_time = std::min(serial_commands_times[i], min_time);
+        }
+        // Just need to apply the regression now
+        for (int i = 0; i < commands_uniq_vec.size(); i++) {
+          const auto name_command = commands_uniq_vec[i];
+          const auto name_parameter = commands_to_parameters_tunned(name_command);
+          if (commands_parameters_cli[name_parameter] == -1) {
+            // Todo check if new_parameter >= max possible values
+            long new_parameter =
+                (1. * min_time) / serial_commands_times[i] * commands_parameters[name_parameter];
+            commands_parameters[name_parameter] = new_parameter;
+          }
+        }
+      }
+
+      std::cout << "Parameters used:" << std::endl;
+      if (std::any_of(commands_uniq.begin(), commands_uniq.end(),
+                      [](const auto &c) { return c.find('M') != std::string::npos; }))
+        std::cout << "  M policy: " << to_string(host_policy) << std::endl;
+      if (commands_parameters["devices"] != DEVICES_SINGLE)
+        std::cout << "  devices: "
+                  << (commands_parameters["devices"] == DEVICES_NUMA ? "numa" : "all")
+                  << std::endl;
+      for (const auto k : commands_uniq) {
+        const auto name_parameter = commands_to_parameters_tunned(k);
+        std::cout << "  " << name_parameter << ": " << commands_parameters[name_parameter]
+                  << std::endl;
+        if (k == "C") {
+          for (const auto name : {"globalsize_C", "ilp_C", "vector_C"})
+            std::cout << "  " << name << ": " << commands_parameters[name] << std::endl;
+          std::cout << "  precision_C: " << precision_name(commands_parameters["precision_C"])
+                    << std::endl;
+        }
+        if (k == "T")
+          std::cout << "  intensity_T: " << commands_parameters["intensity_T"] << std::endl;
+        if (k == "advise")
+          std::cout << "  advice: " << commands_parameters["advice"] << std::endl;
+        if (k == "N")
+          std::cout << "  ranks: " << mpi_command_size() << std::endl;
+      }
+
+      for (auto &commands : l_commands) {
+
+        std::stringstream command_str;
+        command_str << mode << " | ";
+        for (const auto &c : commands)
+          command_str << c << " ";
+        std::cout << "# " << command_str.str() << "| Starting Benchmarking..." << std::endl;
+
+        result_record_t record;
+        record.binary = argv[0];
+        record.mode = mode;
+        record.dtype = precision_name(dtype);
+        record.device = device_name;
+        record.ranks = mpi_command_size();
+        for (const auto &c : commands) {
+          record.commands += (record.commands.empty() ? "" : " ") + c;
+          record.bytes += command_bytes(c, sizeof(T), commands_parameters);
+          record.flop += command_flop(c, commands_parameters);
+        }
+        record.env = capture_env();
+        record.parameters.insert(commands_parameters.begin(), commands_parameters.end());
+        const auto save_record = [&]() {
+          if (!output_path.empty() && mpi_rank == 0)
+            write_record(output_path, record);
+        };
+
+        // Serial Reference
+
+        const auto serial = bench<T>("serial", commands, commands_parameters, enable_profiling,
+                                     n_queues, n_repetitions, verbose);
+        const auto &serial_total_time = serial.total_time;
+        const auto &serial_commands_times = serial.commands_times;
+        record.serial_time = serial_total_time;
+        record.serial_samples = serial.samples;
+        for (size_t i = 0; i < commands.size(); i++)
+          record.serial_commands.push_back(
+              {commands[i], serial_commands_times[i],
+               command_bytes(commands[i], sizeof(T), commands_parameters),
+               command_flop(commands[i], commands_parameters), serial.commands_samples[i]});
+        std::cout << "Minimum Measured Total Time Serial: " << serial_total_time << "us"
+                  << std::endl;
+        for (size_t i = 0; i < commands.size(); i++) {
+          std::cout << "  Minimum Time Command " << i << " (" << std::setw(3) << commands[i]
+                    << "): "
+                    << time_info<T>({commands[i]}, serial_commands_times[i], commands_parameters)
+                    << std::endl;
+        }
+        // Strided copies against a contiguous copy of the same bytes
+        for (size_t i = 0; i < commands.size(); i++) {
+          copy2d_t copy2d;
+          if (!parse_copy2d(commands[i], copy2d))
+            continue;
+          std::vector<std::string> contiguous{command_kinds(commands[i])};
+          auto contiguous_parameters = commands_parameters;
+          contiguous_parameters["globalsize_" + contiguous[0]] = copy2d.rows * copy2d.cols;
+          const auto contiguous_time =
+              bench<T>("serial", contiguous, contiguous_parameters, enable_profiling, n_queues,
+                       n_repetitions, verbose)
+                  .commands_times[0];
+          std::cout << "  Contiguous " << contiguous[0] << " of the same bytes: "
+                    << time_info<T>(contiguous, contiguous_time, contiguous_parameters)
+                    << " (strided/contiguous bandwidth: "
+                    << (1. * contiguous_time) / serial_commands_times[i] << ")" << std::endl;
+        }
+        const double max_speedup =
+            (1. * serial_total_time) /
+            *std::max_element(serial_commands_times.begin(), serial_commands_times.end());
+        std::cout << "Maximum Theoretical Speedup: " << max_speedup << "x" << std::endl;
+        record.max_speedup = max_speedup;
+
+        if (commands.size() >= 1 && max_speedup <= 1.50)
+          std::cerr << "  WARNING: Large Unbalance Between Commands" << std::endl;
+
+        // Weak scaling: each point has proportionally more commands and queues/threads
+        if (max_queues_sweep) {
+          const auto sweep = bench_sweep<T>(mode, commands, commands_parameters,
+                                            enable_profiling, max_queues_sweep, n_repetitions,
+                                            verbose);
+          const auto &sweep_times = sweep.sweep_times;
+          std::cout << "Sweep of queues/threads:" << std::endl;
+          for (int k = 0, n_queues = 1; k < sweep_times.size(); k++, n_queues *= 2) {
+            std::vector<std::string> commands_k;
+            for (int j = 0; j < n_queues; j++)
+              commands_k.insert(commands_k.end(), commands.begin(), commands.end());
+            std::cout << "  Queues " << std::setw(3) << n_queues << " | Commands " << std::setw(4)
+                      << commands_k.size() << " | "
+                      << time_info<T>(commands_k, sweep_times[k], commands_parameters) << " | "
+                      << (1. * commands_k.size()) / sweep_times[k] << " Mcommands/s"
+                      << " | Efficiency: " << (1. * sweep_times[0]) / sweep_times[k] << std::endl;
+          }
+          record.mode = sweep.mode;
+          record.sweep_times = sweep_times;
+          record.status = "SWEEP";
+          save_record();
+          continue;
+        }
+
+        // Run in //
+        const auto concurent = bench<T>(mode, commands, commands_parameters, enable_profiling,
+                                        n_queues, n_repetitions, verbose);
+        const auto &concurent_total_time = concurent.total_time;
+
+        // Analysis
+        int pci_erno = 0;
+        std::cout << "Minimum Measured Total Time //: "
+                  << time_info<T>(commands, concurent_total_time, commands_parameters,
+                                  min_bandwidth, &pci_erno)
+                  << std::endl;
+        std::cout << "Minimum Host Submission Time //: " << concurent.submission_time << "us"
+                  << std::endl;
+        const double speedup = (1. * serial_total_time) / concurent_total_time;
+        std::cout << "Speedup Relative to Serial: " << speedup << "x" << std::endl;
+        record.mode = concurent.mode;
+        record.concurent_time = concurent_total_time;
+        record.submission_time = concurent.submission_time;
+        record.concurent_samples = concurent.samples;
+        record.speedup = speedup;
+        dtype_table.push_back({precision_name(dtype), command_str.str(), serial_total_time,
+                               concurent_total_time,
+                               time_info<T>(commands, concurent_total_time, commands_parameters),
+                               speedup});
+
+        // Aggregate of the sub-devices/devices against the same mode on the single device
+        if (commands_parameters["devices"] != DEVICES_SINGLE) {
+          auto single_parameters = commands_parameters;
+          single_parameters["devices"] = DEVICES_SINGLE;
+          const auto single = bench<T>(mode, commands, single_parameters, enable_profiling,
+                                       n_queues, n_repetitions, verbose);
+          std::cout << "Minimum Measured Total Time // Single Device: "
+                    << time_info<T>(commands, single.total_time, commands_parameters) << std::endl;
+          std::cout << "Speedup Relative to Single Device: "
+                    << (1. * single.total_time) / concurent_total_time << "x" << std::endl;
+        }
+        std::cout << "## " << command_str.str();
+        if (pci_erno != 0) {
+          std::cout << "| FAILURE: Minimun Bandwish not reached" << std::endl;
+          exit_code = 1;
+          record.status = "FAILURE";
+        } else if (max_speedup >= ((1. + TOL_SPEEDUP) * speedup)) {
+          std::cout << "| FAILURE: Far from Theoretical Speedup" << std::endl;
+          exit_code = 1;
+          record.status = "FAILURE";
+        } else {
+          std::cout << "| SUCCESS: Close from Theoretical Speedup" << std::endl;
+          record.status = "SUCCESS";
+        }
+        save_record();
+      }
+    });
+
+  if (dtype_table.size() > 1) {
+    std::cout << "# Summary per dtype" << std::endl;
+    for (const auto &row : dtype_table)
+      std::cout << std::setw(6) << row.dtype << " | " << row.commands << "| Serial: "
+                << row.serial_time << "us | //: " << row.concurent_info << " | Speedup: "
+                << row.speedup << "x" << std::endl;
   }
+  release_arena();
+  mpi_command_finalize();
   exit(exit_code);
 }
@@ -0,0 +1,80 @@
+#pragma once
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <iostream>
+
+// Network command 'N': Isend/Irecv of its buffer with a partner rank, in a build with -DUSE_MPI.
+// The partner of `rank` is `rank ^ 1` (itself for the last rank of an odd number of ranks).
+// The times of every repetition are reduced (max) over the ranks, so all the ranks take the same
+// decisions (autotuning) and report the slowest one.
+// Without USE_MPI, all the helpers are no-op and 'N' is rejected by `main`
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+// Transfers are posted by host tasks and host threads, concurrently with each other
+inline int mpi_command_init(int *argc, char ***argv) {
+#ifdef USE_MPI
+  int provided;
+  MPI_Init_thread(argc, argv, MPI_THREAD_MULTIPLE, &provided);
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (provided < MPI_THREAD_MULTIPLE && rank == 0)
+    std::cerr << "  WARNING: MPI_THREAD_MULTIPLE not provided, concurrent 'N' commands may fail"
+              << std::endl;
+  return rank;
+#else
+  return 0;
+#endif
+}
+
+inline void mpi_command_finalize() {
+#ifdef USE_MPI
+  int initialized, finalized;
+  MPI_Initialized(&initialized);
+  MPI_Finalized(&finalized);
+  if (initialized && !finalized)
+    MPI_Finalize();
+#endif
+}
+
+inline int mpi_command_size() {
+#ifdef USE_MPI
+  int size;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  return size;
+#else
+  return 1;
+#endif
+}
+
+// Start each repetition at the same time on all the ranks
+inline void mpi_command_barrier() {
+#ifdef USE_MPI
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+}
+
+// In place max of `times` over the ranks
+inline void mpi_command_max(long *times, int count) {
+#ifdef USE_MPI
+  MPI_Allreduce(MPI_IN_PLACE, times, count, MPI_LONG, MPI_MAX, MPI_COMM_WORLD);
+#endif
+}
+
+// Send `send` to the partner and receive its `recv`, `bytes` each way. `tag` is the index of the
+// command, so concurrent 'N' commands (`N N`) never match each other's messages
+inline void mpi_command_exchange(const void *send, void *recv, size_t bytes, int tag) {
+#ifdef USE_MPI
+  assert(bytes <= INT_MAX && "'N' message larger than 2 GBytes");
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  const int partner = ((rank ^ 1) < size) ? (rank ^ 1) : rank;
+  MPI_Request requests[2];
+  MPI_Irecv(recv, bytes, MPI_BYTE, partner, tag, MPI_COMM_WORLD, &requests[0]);
+  MPI_Isend(send, bytes, MPI_BYTE, partner, tag, MPI_COMM_WORLD, &requests[1]);
+  MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+#endif
+}
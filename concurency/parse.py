@@ -1,5 +1,8 @@
 #!/usr/bin/env python3
+# Summarize the records of `--output <file>.jsonl`: one table per environment,
+# one line per list of COMMANDS (and dtype), one column per mode
 import sys
+import json
 from tabulate import tabulate
 from collections import defaultdict
 
@@ -10,20 +13,20 @@ except IndexError:
     style = "simple"
 
 with open(path_file) as f:
-    lines = f.readlines()
+    records = [json.loads(line) for line in f if line.strip()]
 
 d_result = defaultdict(lambda: defaultdict(dict))
-env = None
-for line in lines:
-    if "export" in line:
-        env = line.split("export")[1].strip()
-    elif any(t in line for t in ["FAILURE", "SUCCESS"]):
-        if "FAILURE" in line:
-            result = "FAILURE"
-        elif "SUCCESS" in line:
-            result = "SUCCESS"
-        type_of_concurency, argv, *_ = line[2:].split('|') # Remove ## prefix
-        d_result[env][" ".join(argv.split())][type_of_concurency.strip()] = result
+for r in records:
+    env = " ".join(f"{k}={v}" for k, v in sorted(r["env"].items()))
+    commands = r["commands"] if r["dtype"] == "float" else f"{r['commands']} ({r['dtype']})"
+    if r["status"] == "SWEEP":
+        result = "SWEEP " + " ".join(f"{t}us" for t in r["sweep_us"])
+    else:
+        # Speedups are null when a time is 0
+        speedup, max_speedup = (f"{x:.2f}x" if x is not None else "-"
+                                for x in (r["speedup"], r["max_speedup"]))
+        result = f"{r['status']} {speedup}/{max_speedup}"
+    d_result[env][commands][r["mode"]] = result
 
 for name, table_data in d_result.items():
     l_of_dict = [{"commands": name, **type_} for name, type_ in table_data.items()]
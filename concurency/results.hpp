@@ -0,0 +1,176 @@
+#pragma once
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+extern char **environ;
+
+// Structured results (`--output <file>`): one record per list of COMMANDS and dtype,
+// appended as a JSON line (`.json`, `.jsonl`) or a CSV row (anything else).
+// Times are in us, samples are the times of each repetition. See `compare.py`
+struct command_record_t {
+  std::string command;
+  long time;
+  size_t bytes, flop;
+  std::vector<long> samples;
+};
+
+struct result_record_t {
+  std::string binary, mode, dtype, device, commands;
+  int ranks = 1;
+  std::map<std::string, std::string> env;
+  std::map<std::string, size_t> parameters;
+  std::vector<command_record_t> serial_commands;
+  long serial_time = 0;
+  std::vector<long> serial_samples;
+  long concurent_time = 0, submission_time = 0;
+  std::vector<long> concurent_samples;
+  size_t bytes = 0, flop = 0;
+  double max_speedup = 0, speedup = 0;
+  std::vector<long> sweep_times; // Instead of the concurrent run with `--sweep`
+  std::string status;
+};
+
+// Runtime and driver knobs the `run_*.sh` scripts play with
+inline std::map<std::string, std::string> capture_env() {
+  static const char *prefixes[] = {"ZE_",    "SYCL_",        "ONEAPI_",
+                                   "DPCPP_", "OMP_",         "LIBOMPTARGET_",
+                                   "I_MPI_", "MPICH_",       "EnableFlushTaskSubmission"};
+  std::map<std::string, std::string> env;
+  for (char **e = environ; *e; e++) {
+    const std::string kv(*e);
+    const auto pos = kv.find('=');
+    for (const auto prefix : prefixes)
+      if (kv.rfind(prefix, 0) == 0 && pos != std::string::npos)
+        env[kv.substr(0, pos)] = kv.substr(pos + 1);
+  }
+  return env;
+}
+
+// Control characters (environment values may hold any) are escaped, as JSON requires
+inline std::string json_string(const std::string &s) {
+  std::string out = "\"";
+  for (const auto c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else if (c == '\t') {
+      out += "\\t";
+    } else if (c == '\r') {
+      out += "\\r";
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+// RFC 4180 field: quoted, with its quotes doubled
+inline std::string csv_string(const std::string &s) {
+  std::string out = "\"";
+  for (const auto c : s)
+    out += (c == '"') ? std::string("\"\"") : std::string(1, c);
+  return out + "\"";
+}
+
+inline std::string json_array(const std::vector<long> &v) {
+  std::stringstream sout;
+  sout << "[";
+  for (size_t i = 0; i < v.size(); i++)
+    sout << (i ? ", " : "") << v[i];
+  sout << "]";
+  return sout.str();
+}
+
+// GBytes/s and GFlop/s, 0 when not applicable
+inline double rate(size_t quantity, long time) { return time ? (1E-3) * quantity / time : 0; }
+
+// A ratio of times can be inf or nan when a time is 0 (sub-microsecond commands), not valid JSON:
+// `null`, or an empty CSV cell
+inline std::string number(double x, const std::string &non_finite) {
+  if (!std::isfinite(x))
+    return non_finite;
+  std::stringstream sout;
+  sout << x;
+  return sout.str();
+}
+
+inline std::string to_json(const result_record_t &r) {
+  std::stringstream sout;
+  sout << "{\"binary\": " << json_string(r.binary) << ", \"mode\": " << json_string(r.mode)
+       << ", \"dtype\": " << json_string(r.dtype) << ", \"device\": " << json_string(r.device)
+       << ", \"ranks\": " << r.ranks << ", \"commands\": " << json_string(r.commands);
+  sout << ", \"env\": {";
+  for (auto it = r.env.begin(); it != r.env.end(); it++)
+    sout << (it == r.env.begin() ? "" : ", ") << json_string(it->first) << ": "
+         << json_string(it->second);
+  sout << "}, \"parameters\": {";
+  for (auto it = r.parameters.begin(); it != r.parameters.end(); it++)
+    sout << (it == r.parameters.begin() ? "" : ", ") << json_string(it->first) << ": "
+         << it->second;
+  sout << "}, \"serial\": {\"time_us\": " << r.serial_time
+       << ", \"samples_us\": " << json_array(r.serial_samples) << ", \"commands\": [";
+  for (size_t i = 0; i < r.serial_commands.size(); i++) {
+    const auto &c = r.serial_commands[i];
+    sout << (i ? ", " : "") << "{\"command\": " << json_string(c.command)
+         << ", \"time_us\": " << c.time << ", \"bytes\": " << c.bytes
+         << ", \"bandwidth_GBs\": " << rate(c.bytes, c.time) << ", \"flop\": " << c.flop
+         << ", \"GFlops\": " << rate(c.flop, c.time)
+         << ", \"samples_us\": " << json_array(c.samples) << "}";
+  }
+  sout << "]}";
+  if (!r.sweep_times.empty()) {
+    sout << ", \"sweep_us\": " << json_array(r.sweep_times);
+  } else {
+    sout << ", \"concurent\": {\"time_us\": " << r.concurent_time
+         << ", \"submission_time_us\": " << r.submission_time
+         << ", \"bandwidth_GBs\": " << rate(r.bytes, r.concurent_time)
+         << ", \"GFlops\": " << rate(r.flop, r.concurent_time)
+         << ", \"samples_us\": " << json_array(r.concurent_samples) << "}";
+  }
+  sout << ", \"max_speedup\": " << number(r.max_speedup, "null")
+       << ", \"speedup\": " << number(r.speedup, "null")
+       << ", \"status\": " << json_string(r.status) << "}";
+  return sout.str();
+}
+
+// Flat row, the samples of the concurrent run are joined with ';'
+inline std::string csv_header() {
+  return "binary,mode,dtype,device,ranks,commands,serial_time_us,concurent_time_us,"
+         "submission_time_us,bandwidth_GBs,GFlops,max_speedup,speedup,status,samples_us";
+}
+
+inline std::string to_csv(const result_record_t &r) {
+  std::stringstream sout;
+  sout << csv_string(r.binary) << "," << r.mode << "," << r.dtype << ","
+       << csv_string(r.device) << "," << r.ranks << "," << csv_string(r.commands) << ","
+       << r.serial_time << "," << r.concurent_time << "," << r.submission_time << ","
+       << rate(r.bytes, r.concurent_time) << "," << rate(r.flop, r.concurent_time) << ","
+       << number(r.max_speedup, "") << "," << number(r.speedup, "") << "," << r.status << ",";
+  for (size_t i = 0; i < r.concurent_samples.size(); i++)
+    sout << (i ? ";" : "") << r.concurent_samples[i];
+  return sout.str();
+}
+
+inline void write_record(const std::string &path, const result_record_t &r) {
+  const auto ends_with = [&](const std::string &suffix) {
+    return path.size() >= suffix.size() && path.substr(path.size() - suffix.size()) == suffix;
+  };
+  const bool json = ends_with(".json") || ends_with(".jsonl");
+  const bool empty = !std::ifstream(path).good();
+  std::ofstream out(path, std::ios::app);
+  if (json)
+    out << to_json(r) << std::endl;
+  else
+    out << (empty ? csv_header() + "\n" : "") << to_csv(r) << std::endl;
+}
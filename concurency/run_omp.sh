@@ -3,12 +3,11 @@ set -o xtrace
 
 cd $(mktemp -d tmp-omp-XXXX)
 
-icpx -fiopenmp -fopenmp-targets=spir64 -std=c++17 ../bench_omp.cpp ../main.cpp -DHOST_THREADS -o omp_host_threads
-icpx -fiopenmp -fopenmp-targets=spir64 -std=c++17 ../bench_omp.cpp ../main.cpp -DNOWAIT -o omp_nowait
+icpx -fiopenmp -fopenmp-targets=spir64 -std=c++17 ../bench_omp.cpp ../main.cpp -o omp_con
 
 LCOMMANDS=("C C" "C M2D" "C D2M" "M2D D2M" "H2D D2H")
 
-rm -f omp.log
+rm -f omp.log omp.jsonl
 export PrintDebugSettings=1
 
 for envs in "ZE_AFFINITY_MASK=0.0" \
@@ -19,11 +18,11 @@ for envs in "ZE_AFFINITY_MASK=0.0" \
 do
     (
     export $envs
-    for mode in "host_threads" "nowait"
+    for mode in "host_threads" "nowait" "tasks" "interop"
     do
-    	./omp_$mode "$mode" ${LCOMMANDS[@]/#/--commands }
+    	./omp_con "$mode" ${LCOMMANDS[@]/#/--commands } --output omp.jsonl
     done
    ) |& tee -a omp.log
 done
 
-../parse.py omp.log
+../parse.py omp.jsonl
@@ -5,7 +5,7 @@ cd $(mktemp -d tmp-sycl-XXXX)
 
 icpx -fsycl -std=c++17 ../bench_sycl.cpp ../main.cpp -o sycl
 
-rm -f sycl.log
+rm -f sycl.log sycl.jsonl
 export PrintDebugSettings=1
 
 LCOMMANDS=("C C" "C M2D" "C D2M" "M2D D2M" "H2D D2H")
@@ -17,12 +17,12 @@ for envs in "ZE_AFFINITY_MASK=0.0" \
 do
     (
     export $envs
-    for mode in "out_of_order" "in_order"
+    for mode in "out_of_order" "in_order" "graph"
     do
-     	./sycl "$mode" ${LCOMMANDS[@]/#/--commands }
+     	./sycl "$mode" ${LCOMMANDS[@]/#/--commands } --output sycl.jsonl
         #./sycl "$mode" ${COMMANDS[@]/#/--commands } --enable_profiling
     done
     ) |& tee -a sycl.log
 done
 
-../parse.py sycl.log
+../parse.py sycl.jsonl
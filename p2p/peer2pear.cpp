@@ -1,156 +1,1190 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
 #include <limits>
 #include <mpi.h>
+#include <numeric>
 #include <random>
+#include <sstream>
+#include <string>
 #include <sycl/sycl.hpp>
+#include <thread>
 #include <vector>
 
-void fill_randomly(sycl::queue Q, int N, std::vector<float *> ptrs) {
-  std::vector<float> v(N);
-  std::iota(v.begin(), v.end(), 0);
+// `selector`: cpu | gpu | <index> in the list of all the devices |
+//   <filter> contained in "<platform name>: <device name>"
+sycl::device select_device(std::string selector) {
+  // One pinned thread per core on a CPU device, set before the SYCL runtime starts
+  if (selector != "gpu") {
+    setenv("DPCPP_CPU_PLACES", "cores", 0);
+    setenv("DPCPP_CPU_CU_AFFINITY", "close", 0);
+  }
+  if (selector == "gpu")
+    return sycl::device{sycl::gpu_selector_v};
+  if (selector == "cpu")
+    return sycl::device{sycl::cpu_selector_v};
+  const auto devices = sycl::device::get_devices();
+  if (!selector.empty() && std::all_of(selector.begin(), selector.end(), ::isdigit) &&
+      std::stoul(selector) < devices.size())
+    return devices[std::stoul(selector)];
+  for (const auto &D : devices) {
+    const auto name = D.get_platform().get_info<sycl::info::platform::name>() + ": " +
+                      D.get_info<sycl::info::device::name>();
+    if (name.find(selector) != std::string::npos)
+      return D;
+  }
+  std::cerr << "ERROR: No device matching '" << selector << "'" << std::endl;
+  MPI_Abort(MPI_COMM_WORLD, 1);
+  return {};
+}
+
+// Element `i` of the data sent by `rank`: a hash of both, below 2^24 so exact in float
+inline float pattern(int rank, size_t i) {
+  uint32_t x = static_cast<uint32_t>(i) * 0x9E3779B1u;
+  x ^= static_cast<uint32_t>(rank + 1) * 0x85EBCA77u;
+  x ^= x >> 15;
+  x *= 0x2C1B3C6Du;
+  x ^= x >> 12;
+  return static_cast<float>(x & 0xFFFFFF);
+}
+
+// Set once by `main`, compare the received data on the host instead of the device (debug)
+bool verify_on_host = false;
+
+// Memory SYCL does not know (the one of MPI_Win_allocate) can only be touched by the host
+bool is_host_only(sycl::queue Q, const void *ptr) {
+  return sycl::get_pointer_type(ptr, Q.get_context()) == sycl::usm::alloc::unknown;
+}
+
+// The data `rank` sends, generated in place
+void fill_pattern(sycl::queue Q, int N, float *ptr, int rank) {
+  if (is_host_only(Q, ptr)) {
+    for (int i = 0; i < N; i++)
+      ptr[i] = pattern(rank, i);
+    return;
+  }
+  Q.parallel_for(sycl::range<1>(N), [=](sycl::id<1> i) { ptr[i] = pattern(rank, i); }).wait();
+}
+
+// Before each transfer: `pattern` does not depend on the size, so the data left by a previous
+// transfer would let a truncated or dropped one pass `verify`. -1 is never a `pattern` value
+void poison(sycl::queue Q, int N, const std::vector<std::pair<int, float *>> &recvs) {
+  for (auto &[_, ptr] : recvs) {
+    if (is_host_only(Q, ptr))
+      std::fill_n(ptr, N, -1.f);
+    else
+      Q.fill(ptr, -1.f, N).wait();
+  }
+}
+
+// Abort if a buffer of `recvs` is not the data of its source. The wrong elements are counted by a
+// device reduction, or on the host after a copy with `verify_on_host`
+void verify(sycl::queue Q, int N, const std::vector<std::pair<int, float *>> &recvs) {
+  for (auto &[src, ptr] : recvs) {
+    unsigned long errors = 0;
+    if (is_host_only(Q, ptr)) {
+      for (int i = 0; i < N; i++)
+        errors += ptr[i] != pattern(src, i);
+    } else if (verify_on_host) {
+      std::vector<float> h(N);
+      Q.copy(ptr, h.data(), N).wait();
+      for (int i = 0; i < N; i++)
+        errors += h[i] != pattern(src, i);
+    } else {
+      auto *d_errors = sycl::malloc_shared<unsigned long>(1, Q);
+      *d_errors = 0;
+      const auto *p = ptr;
+      const int rank = src;
+      Q.parallel_for(sycl::range<1>(N), sycl::reduction(d_errors, sycl::plus<unsigned long>()),
+                     [=](sycl::id<1> i, auto &e) { e += p[i] != pattern(rank, i); })
+          .wait();
+      errors = *d_errors;
+      sycl::free(d_errors, Q);
+    }
+    if (errors) {
+      std::cerr << "ERROR: " << errors << " wrong elements out of " << N << " received from rank "
+                << src << std::endl;
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+  }
+}
+
+// Model of the local clock relative to the one of rank 0:
+//   global = local + offset + drift * (local - reference), in ns
+struct clock_model_t {
+  long reference = 0;
+  long offset = 0;
+  double drift = 0;
+  unsigned long global(unsigned long local) const {
+    return local + offset + std::llround(drift * (static_cast<long>(local) - reference));
+  }
+};
+
+// Set once by `main` with `clock_sync`, corrects the timestamps of all the ranks before their
+// reduction
+clock_model_t clock_model;
 
-  std::minstd_rand g;
-  for (auto &ptr : ptrs) {
-    std::shuffle(v.begin(), v.end(), g);
-    Q.copy(v.data(), ptr, N).wait();
+long local_now() { return std::chrono::high_resolution_clock::now().time_since_epoch().count(); }
+
+// Offset and drift estimation in the style of SKaMPI/ReproMPI, rank 0 against each other rank in
+// turn. Each of the `num_fitpoints` offsets is the one of the ping-pong with the minimal round-trip
+// out of `num_exchanges` (the time of rank 0 is assumed in the middle of the round-trip). The
+// fitpoints are `interval` apart so the drift, the slope of the linear fit of the offsets over the
+// local time, is not only noise. No correction for 0 fitpoints
+clock_model_t clock_sync(int num_fitpoints, int num_exchanges,
+                         std::chrono::milliseconds interval = std::chrono::milliseconds(10)) {
+  int world_size, world_rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  clock_model_t model;
+  if (num_fitpoints == 0)
+    return model;
+
+  std::vector<double> xs, ys;
+  long base = 0;
+  for (int f = 0; f < num_fitpoints; f++) {
+    if (f)
+      std::this_thread::sleep_for(interval);
+    for (int peer = 1; peer < world_size; peer++) {
+      if (world_rank != 0 && world_rank != peer)
+        continue;
+      long min_rtt = std::numeric_limits<long>::max(), offset = 0, middle = 0;
+      for (int e = 0; e < num_exchanges; e++) {
+        long t_root;
+        if (world_rank == 0) {
+          MPI_Recv(&t_root, 1, MPI_LONG, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+          t_root = local_now();
+          MPI_Send(&t_root, 1, MPI_LONG, peer, 0, MPI_COMM_WORLD);
+          continue;
+        }
+        const long t_send = local_now();
+        MPI_Send(&t_send, 1, MPI_LONG, 0, 0, MPI_COMM_WORLD);
+        MPI_Recv(&t_root, 1, MPI_LONG, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        const long t_recv = local_now();
+        if (t_recv - t_send < min_rtt) {
+          min_rtt = t_recv - t_send;
+          middle = t_send + (t_recv - t_send) / 2;
+          offset = t_root - middle;
+        }
+      }
+      if (world_rank == 0)
+        continue;
+      // Relative to the first fitpoint, to keep the precision of the fit
+      if (f == 0) {
+        model.reference = middle;
+        base = offset;
+      }
+      xs.push_back(middle - model.reference);
+      ys.push_back(offset - base);
+    }
+  }
+
+  if (world_rank != 0) {
+    const double mean_x = std::accumulate(xs.begin(), xs.end(), 0.) / xs.size();
+    const double mean_y = std::accumulate(ys.begin(), ys.end(), 0.) / ys.size();
+    double cov = 0, var = 0;
+    for (size_t i = 0; i < xs.size(); i++) {
+      cov += (xs[i] - mean_x) * (ys[i] - mean_y);
+      var += (xs[i] - mean_x) * (xs[i] - mean_x);
+    }
+    model.drift = var ? cov / var : 0;
+    model.offset = base + std::llround(mean_y - model.drift * mean_x);
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+  return model;
+}
+
+// Time (ns) of a step over all the ranks, from the first start to the last end once the local
+// timestamps are corrected by `clock_model`. `rank_times`: from that first start to the end of
+// each rank, to see the slow ones
+unsigned long global_time(unsigned long l_start, unsigned long l_end,
+                          std::vector<unsigned long> *rank_times = nullptr) {
+  const unsigned long g_start = clock_model.global(l_start), g_end = clock_model.global(l_end);
+  unsigned long start, end;
+  MPI_Allreduce(&g_start, &start, 1, MPI_UNSIGNED_LONG, MPI_MIN, MPI_COMM_WORLD);
+  MPI_Allreduce(&g_end, &end, 1, MPI_UNSIGNED_LONG, MPI_MAX, MPI_COMM_WORLD);
+  if (rank_times) {
+    int world_size;
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    rank_times->resize(world_size);
+    const unsigned long rank_time = g_end - start;
+    MPI_Allgather(&rank_time, 1, MPI_UNSIGNED_LONG, rank_times->data(), 1, MPI_UNSIGNED_LONG,
+                  MPI_COMM_WORLD);
   }
+  return end - start;
 }
 
+// Minimum time (ns) over `num_iteration` transfers of `N` floats, after `num_warmup` untimed ones.
+// Each transfer is striped in `stripes` concurrent requests of contiguous chunks, chunk `c` on
+// `comms[c % comms.size()]`. `rank_times`: the ones of each rank in that transfer
 unsigned long datatransfer(sycl::queue Q, int N, std::vector<std::pair<int, float *>> &sends,
-                           std::vector<std::pair<int, float *>> &recvs) {
+                           std::vector<std::pair<int, float *>> &recvs, int num_warmup,
+                           int num_iteration, int stripes = 1,
+                           const std::vector<MPI_Comm> &comms = {MPI_COMM_WORLD},
+                           std::vector<unsigned long> *rank_times = nullptr) {
 
   unsigned long min_time = std::numeric_limits<unsigned long>::max();
-  int num_iteration = 10;
 
-  for (int r = 0; r < num_iteration; r++) {
+  for (int r = -num_warmup; r < num_iteration; r++) {
     MPI_Barrier(MPI_COMM_WORLD);
     const unsigned long l_start =
         std::chrono::high_resolution_clock::now().time_since_epoch().count();
 
     std::vector<MPI_Request> requests;
 
-    for (auto &[dest, ptr] : sends) {
-      MPI_Request request = MPI_REQUEST_NULL;
-      MPI_Isend(ptr, N, MPI_FLOAT, dest, 0, MPI_COMM_WORLD, &request);
-      requests.push_back(request);
-    }
+    for (int c = 0; c < stripes; c++) {
+      const int begin = (1L * c * N) / stripes;
+      const int count = (1L * (c + 1) * N) / stripes - begin;
+      const auto comm = comms[c % comms.size()];
 
-    for (auto &[src, ptr] : recvs) {
-      MPI_Request request = MPI_REQUEST_NULL;
-      MPI_Irecv(ptr, N, MPI_FLOAT, src, 0, MPI_COMM_WORLD, &request);
-      requests.push_back(request);
+      for (auto &[dest, ptr] : sends) {
+        MPI_Request request = MPI_REQUEST_NULL;
+        MPI_Isend(ptr + begin, count, MPI_FLOAT, dest, c, comm, &request);
+        requests.push_back(request);
+      }
+
+      for (auto &[src, ptr] : recvs) {
+        MPI_Request request = MPI_REQUEST_NULL;
+        MPI_Irecv(ptr + begin, count, MPI_FLOAT, src, c, comm, &request);
+        requests.push_back(request);
+      }
     }
 
     MPI_Waitall(requests.size(), requests.data(), MPI_STATUS_IGNORE);
 
     const unsigned long l_end =
         std::chrono::high_resolution_clock::now().time_since_epoch().count();
-    unsigned long start, end;
-    MPI_Reduce(&l_start, &start, 1, MPI_UNSIGNED_LONG, MPI_MIN, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&l_end, &end, 1, MPI_UNSIGNED_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
-    const unsigned long time = end - start;
-    min_time = std::min(time, min_time);
+    std::vector<unsigned long> times;
+    const unsigned long time = global_time(l_start, l_end, rank_times ? &times : nullptr);
+    if (r >= 0 && time < min_time) {
+      min_time = time;
+      if (rank_times)
+        *rank_times = times;
+    }
   }
 
-  // Verify results
-  std::vector<float> h(N);
-  for (auto &[_, ptr] : recvs) {
-    Q.copy(ptr, h.data(), N).wait();
-    float theo = (1L * N * (N - 1)) / 2.;
-    std::sort(h.begin(), h.end());
-    float sum = std::accumulate(h.begin(), h.end(), 0.);
-    assert(sum == theo);
-  }
+  verify(Q, N, recvs);
 
   return min_time;
 }
 
-unsigned long datatransfer_win(MPI_Win win, sycl::queue Q, int N,
+// RMA window over one buffer of 2 * `N` floats: `a` (sent, origin of `get`) then `b` (received,
+// target of `put` and `accumulate`). Displacements are in bytes, `base[rank]` is the one of `a` on
+// `rank`: 0, or its address for a dynamic window
+struct window_t {
+  MPI_Win win = MPI_WIN_NULL;
+  std::vector<MPI_Aint> base;
+  MPI_Aint b_offset = 0;
+};
+
+// `create`: MPI_Win_create over `ptr`. `dynamic`: MPI_Win_create_dynamic then MPI_Win_attach.
+// `allocate`: MPI_Win_allocate, the memory belongs to MPI and `ptr` is set to it
+window_t window_open(std::string kind, float *&ptr, size_t N) {
+  int world_size;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  const MPI_Aint bytes = 2 * N * sizeof(float);
+  window_t w;
+  w.base.resize(world_size, 0);
+  w.b_offset = N * sizeof(float);
+  if (kind == "allocate") {
+    MPI_Win_allocate(bytes, 1, MPI_INFO_NULL, MPI_COMM_WORLD, &ptr, &w.win);
+  } else if (kind == "dynamic") {
+    MPI_Win_create_dynamic(MPI_INFO_NULL, MPI_COMM_WORLD, &w.win);
+    MPI_Win_attach(w.win, ptr, bytes);
+    MPI_Aint address;
+    MPI_Get_address(ptr, &address);
+    MPI_Allgather(&address, 1, MPI_AINT, w.base.data(), 1, MPI_AINT, MPI_COMM_WORLD);
+  } else {
+    MPI_Win_create(ptr, bytes, 1, MPI_INFO_NULL, MPI_COMM_WORLD, &w.win);
+  }
+  return w;
+}
+
+void window_close(std::string kind, window_t &w, float *ptr) {
+  if (w.win == MPI_WIN_NULL)
+    return;
+  if (kind == "dynamic")
+    MPI_Win_detach(w.win, ptr);
+  MPI_Win_free(&w.win);
+}
+
+// One RMA operation of `count` `type` with `rank`: `put` and `accumulate` (MPI_REPLACE) write
+// `ptr` in its `b`, `get` reads its `a` in `ptr`. The `put_*` variants only differ by their
+// synchronization
+void rma(std::string transfer, const window_t &w, void *ptr, int count, MPI_Datatype type,
+         int rank) {
+  if (transfer == "get")
+    MPI_Get(ptr, count, type, rank, w.base[rank], count, type, w.win);
+  else if (transfer == "accumulate")
+    MPI_Accumulate(ptr, count, type, rank, w.base[rank] + w.b_offset, count, type, MPI_REPLACE,
+                   w.win);
+  else
+    MPI_Put(ptr, count, type, rank, w.base[rank] + w.b_offset, count, type, w.win);
+}
+
+// Group of the ranks of `peers`, for post-start-complete-wait
+MPI_Group peers_group(const std::vector<std::pair<int, float *>> &peers) {
+  MPI_Group world_group, group;
+  MPI_Comm_group(MPI_COMM_WORLD, &world_group);
+  std::vector<int> ranks;
+  for (auto &[rank, _] : peers)
+    ranks.push_back(rank);
+  MPI_Group_incl(world_group, ranks.size(), ranks.data(), &group);
+  MPI_Group_free(&world_group);
+  return group;
+}
+
+// Same as `datatransfer` with RMA. Synchronization of each transfer by `transfer`:
+//   put, get, accumulate: MPI_Win_fence before and after (collective)
+//   put_lock: MPI_Win_lock_all for all the transfers, MPI_Win_flush after each one
+//   put_pscw: MPI_Win_post/MPI_Win_start before, MPI_Win_complete/MPI_Win_wait after (pairwise)
+// With `get`, the receiving ranks are the origins
+unsigned long datatransfer_win(std::string transfer, const window_t &w, sycl::queue Q, int N,
                                std::vector<std::pair<int, float *>> &sends,
-                               std::vector<std::pair<int, float *>> &recvs) {
+                               std::vector<std::pair<int, float *>> &recvs, int num_warmup,
+                               int num_iteration,
+                               std::vector<unsigned long> *rank_times = nullptr) {
+  auto &accesses = (transfer == "get") ? recvs : sends;
+  auto &exposures = (transfer == "get") ? sends : recvs;
+  const bool fence = transfer == "put" || transfer == "get" || transfer == "accumulate";
+  MPI_Group access_group = MPI_GROUP_NULL, exposure_group = MPI_GROUP_NULL;
+  if (transfer == "put_pscw") {
+    access_group = peers_group(accesses);
+    exposure_group = peers_group(exposures);
+  }
+  if (transfer == "put_lock")
+    MPI_Win_lock_all(0, w.win);
 
   unsigned long min_time = std::numeric_limits<unsigned long>::max();
-  int num_iteration = 10;
 
-  for (int r = 0; r < num_iteration; r++) {
-    MPI_Win_fence(0, win);
+  for (int r = -num_warmup; r < num_iteration; r++) {
+    if (fence)
+      MPI_Win_fence(0, w.win);
+    else
+      MPI_Barrier(MPI_COMM_WORLD);
     const unsigned long l_start =
         std::chrono::high_resolution_clock::now().time_since_epoch().count();
-    for (auto &[dest, ptr] : sends)
-      MPI_Put(ptr, N, MPI_FLOAT, dest, 0, N, MPI_FLOAT, win);
-    MPI_Win_fence(0, win);
+    if (!exposures.empty() && transfer == "put_pscw")
+      MPI_Win_post(exposure_group, 0, w.win);
+    if (!accesses.empty() && transfer == "put_pscw")
+      MPI_Win_start(access_group, 0, w.win);
+    for (auto &[rank, ptr] : accesses) {
+      rma(transfer, w, ptr, N, MPI_FLOAT, rank);
+      if (transfer == "put_lock")
+        MPI_Win_flush(rank, w.win);
+    }
+    if (!accesses.empty() && transfer == "put_pscw")
+      MPI_Win_complete(w.win);
+    if (!exposures.empty() && transfer == "put_pscw")
+      MPI_Win_wait(w.win);
+    if (fence)
+      MPI_Win_fence(0, w.win);
     const unsigned long l_end =
         std::chrono::high_resolution_clock::now().time_since_epoch().count();
-    unsigned long start, end;
-    MPI_Reduce(&l_start, &start, 1, MPI_UNSIGNED_LONG, MPI_MIN, 0, MPI_COMM_WORLD);
-    MPI_Reduce(&l_end, &end, 1, MPI_UNSIGNED_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
-    const unsigned long time = end - start;
-    min_time = std::min(time, min_time);
+    std::vector<unsigned long> times;
+    const unsigned long time = global_time(l_start, l_end, rank_times ? &times : nullptr);
+    if (r >= 0 && time < min_time) {
+      min_time = time;
+      if (rank_times)
+        *rank_times = times;
+    }
   }
 
-  // Verify results
-  std::vector<float> h(N);
-  for (auto &[_, ptr] : recvs) {
-    Q.copy(ptr, h.data(), N).wait();
-    float theo = (1L * N * (N - 1)) / 2.;
-    std::sort(h.begin(), h.end());
-    float sum = std::accumulate(h.begin(), h.end(), 0.);
-    assert(sum == theo);
+  if (transfer == "put_lock") {
+    MPI_Win_unlock_all(w.win);
+    MPI_Barrier(MPI_COMM_WORLD); // The targets only know the data arrived after this point
+  }
+  if (access_group != MPI_GROUP_NULL) {
+    MPI_Group_free(&access_group);
+    MPI_Group_free(&exposure_group);
   }
 
+  verify(Q, N, recvs);
+
   return min_time;
 }
 
+// Half round-trip times (ns) of `num_iteration` ping-pongs of `bytes`: the `ping` rank of the pair
+// sends then receives, the other one receives then sends. Only the `ping` rank returns samples
+std::vector<unsigned long> pingpong(char *ptr, size_t bytes, int peer, bool ping, int num_warmup,
+                                    int num_iteration) {
+  std::vector<unsigned long> samples;
+  MPI_Barrier(MPI_COMM_WORLD);
+  for (int r = -num_warmup; r < num_iteration; r++) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    if (ping) {
+      MPI_Send(ptr, bytes, MPI_BYTE, peer, 0, MPI_COMM_WORLD);
+      MPI_Recv(ptr, bytes, MPI_BYTE, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    } else {
+      MPI_Recv(ptr, bytes, MPI_BYTE, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+      MPI_Send(ptr, bytes, MPI_BYTE, peer, 0, MPI_COMM_WORLD);
+    }
+    const auto end = std::chrono::high_resolution_clock::now();
+    if (ping && r >= 0)
+      samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() /
+                        2);
+  }
+  return samples;
+}
+
+// Times (ns) of one RMA operation of `bytes` by the even rank of the pair, waiting for its
+// remote completion (as osu_put_latency). The odd rank is passive, but with `put_pscw`.
+//   put, get, accumulate: MPI_Win_lock/operation/MPI_Win_unlock
+//   put_lock: MPI_Win_lock_all for all the operations, MPI_Win_flush after each one
+//   put_pscw: MPI_Win_start/MPI_Put/MPI_Win_complete, the odd rank MPI_Win_post/MPI_Win_wait
+std::vector<unsigned long> pingpong_win(std::string transfer, const window_t &w, char *ptr,
+                                        size_t bytes, int peer, int num_warmup,
+                                        int num_iteration) {
+  int world_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  const bool origin = world_rank % 2 == 0;
+  std::vector<unsigned long> samples;
+  MPI_Group group = MPI_GROUP_NULL;
+  if (transfer == "put_pscw" && peer != MPI_PROC_NULL)
+    group = peers_group({{peer, nullptr}});
+  MPI_Barrier(MPI_COMM_WORLD);
+  if (transfer == "put_lock" && origin)
+    MPI_Win_lock_all(0, w.win);
+  for (int r = -num_warmup; r < num_iteration; r++) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    if (transfer == "put_pscw" && !origin) {
+      MPI_Win_post(group, 0, w.win);
+      MPI_Win_wait(w.win);
+      continue;
+    }
+    if (!origin)
+      continue;
+    if (transfer == "put_pscw")
+      MPI_Win_start(group, 0, w.win);
+    else if (transfer != "put_lock")
+      MPI_Win_lock(MPI_LOCK_SHARED, peer, 0, w.win);
+    rma(transfer, w, ptr, bytes, MPI_BYTE, peer);
+    if (transfer == "put_pscw")
+      MPI_Win_complete(w.win);
+    else if (transfer == "put_lock")
+      MPI_Win_flush(peer, w.win);
+    else
+      MPI_Win_unlock(peer, w.win);
+    const auto end = std::chrono::high_resolution_clock::now();
+    if (r >= 0)
+      samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+  }
+  if (transfer == "put_lock" && origin)
+    MPI_Win_unlock_all(w.win);
+  if (group != MPI_GROUP_NULL)
+    MPI_Group_free(&group);
+  MPI_Barrier(MPI_COMM_WORLD);
+  return samples;
+}
+
+void print_help_and_exit(std::string binname, std::string msg) {
+  if (!msg.empty())
+    std::cerr << "ERROR: " << msg << std::endl;
+  std::cerr << "Usage: " << binname
+            << " [<label>] [--device <selector>] [--transfer <transfer>]\n"
+               "           [--pingpong] [--all_pairs <prefix>] [--memory <memory>]\n"
+               "           [--window <window>] [--stripes <k,...>] [--stripe_comms]\n"
+               "           [--pattern <pattern,...>] [--planes <file>]\n"
+               "           [--clock_sync <n_fitpoints>] [--per_rank] [--verify_host]\n"
+               "           [--min_bytes <bytes>] [--max_bytes <bytes>]\n"
+               "           [--warmup <n_warmup>] [--iterations <n_iterations>]\n"
+               "\n"
+               "<label>        [default: Tile2Tile]. Prefix of the reports\n"
+               "--device       [default: gpu]. [possible values: cpu, gpu, <index>, <filter>]\n"
+               "--transfer     [default: isend]. [possible values: isend, put, put_lock, "
+               "put_pscw, get,\n"
+               "                 accumulate, all]\n"
+               "                 isend: MPI_Isend/MPI_Irecv\n"
+               "                 put, get, accumulate: MPI_Put, MPI_Get, MPI_Accumulate "
+               "(MPI_REPLACE) between two fences\n"
+               "                 put_lock: MPI_Put then MPI_Win_flush, in one MPI_Win_lock_all\n"
+               "                 put_pscw: MPI_Put in MPI_Win_post/start/complete/wait\n"
+               "--pingpong     Latency instead of bandwidth: p50/p99/max of the half round-trip "
+               "(isend)\n"
+               "                 or of one RMA operation waiting for its remote completion, "
+               "MPI_Win_lock/unlock\n"
+               "                 for put, get and accumulate. Worst pair\n"
+               "--all_pairs    Every pair of ranks, a round-robin tournament of disjoint pairs "
+               "(isend).\n"
+               "                 Writes the NxN matrices <prefix>_<memory>_bandwidth.csv (GB/s, "
+               "<max_bytes>\n"
+               "                 messages) and <prefix>_<memory>_latency.csv (us, p50 of "
+               "<min_bytes> ping-pongs)\n"
+               "--memory       [default: device]. Buffers [possible values: device, host, mpi, "
+               "all]\n"
+               "                 mpi: allocated by MPI_Win_allocate\n"
+               "--window       [default: create]. RMA window over the device or host buffers\n"
+               "                 [possible values: create (MPI_Win_create), dynamic "
+               "(MPI_Win_create_dynamic), all]\n"
+               "--stripes      Bandwidth of isend with each transfer split in <k> concurrent "
+               "requests, for\n"
+               "                 every <k> of the list (e.g. 1,2,4,8). The gain is relative to "
+               "the first <k>\n"
+               "--stripe_comms One MPI_Comm_dup communicator per chunk, instead of tags on "
+               "MPI_COMM_WORLD\n"
+               "--pattern      Bandwidth of isend traffic patterns, all the flows at once "
+               "[possible values:\n"
+               "                 shift:<k>, permutation, incast, alltoall, bisection]. Each "
+               "flow is received\n"
+               "                 in its own buffer (alltoall: <max_bytes> per peer)\n"
+               "--planes       Output of ./topology, the bisection is between the two halves of "
+               "the planes.\n"
+               "                 The tile of a rank is its ZE_AFFINITY_MASK or "
+               "ONEAPI_DEVICE_SELECTOR.\n"
+               "                 [default: the two halves of the ranks]\n"
+               "--clock_sync   [default: 10]. Fitpoints (10 ms apart) of the offset and drift "
+               "estimation of the\n"
+               "                 clocks against rank 0, the global times are corrected with it. "
+               "0 to disable\n"
+               "--per_rank     Time of each rank (from the first start to its end) after each "
+               "size\n"
+               "--verify_host  Compare the received data on the host (debug), instead of a device "
+               "reduction\n"
+               "--min_bytes    [default: 4, 1 with --pingpong]. First message size of the sweep\n"
+               "--max_bytes    [default: 188743680, 65536 with --pingpong]. Last message size, the "
+               "sizes are doubled\n"
+               "--warmup       [default: 2, 100 with --pingpong]. Untimed transfers before each "
+               "size\n"
+               "--iterations   [default: 10, 1000 with --pingpong]. Timed transfers for each size, "
+               "the minimum\n"
+               "                 (or the percentiles) is reported\n";
+  MPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+// Even ranks send to the next odd one (unidirectional), then both send (bidirectional).
+// One line per size: minimum time of the exchange and aggregated bandwidth of the pairs,
+// followed with `per_rank` by the time of each rank in that exchange
+void sweep(std::string label, std::string transfer, sycl::queue Q, float *a_gpu, float *b_gpu,
+           const window_t &w, size_t min_bytes, size_t max_bytes, int num_warmup,
+           int num_iteration, bool per_rank) {
+  int world_size, world_rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  const int num_pair = world_size / 2;
+  // The last rank of an odd number of ranks has no peer, it only takes part in the collectives
+  const int peer = (world_rank % 2 == 0) ? world_rank + 1 : world_rank - 1;
+  const bool has_peer = peer < world_size;
+
+  for (const bool bidirectional : {false, true}) {
+    if (world_rank == 0)
+      std::cout << "# " << label << " | " << transfer << " | "
+                << (bidirectional ? "Bidirectional" : "Unidirectional") << "\n"
+                << "           Bytes |  Latency (us) | Bandwidth (GB/s)" << std::endl;
+    for (size_t bytes = min_bytes; bytes <= max_bytes; bytes *= 2) {
+      const int N = std::max<size_t>(1, bytes / sizeof(float));
+      const size_t N_byte = N * sizeof(float);
+      std::vector<std::pair<int, float *>> sends;
+      std::vector<std::pair<int, float *>> recvs;
+      if (has_peer && (bidirectional || world_rank % 2 == 0)) {
+        fill_pattern(Q, N, a_gpu, world_rank);
+        sends.push_back({peer, a_gpu});
+      }
+      if (has_peer && (bidirectional || world_rank % 2 == 1))
+        recvs.push_back({peer, b_gpu});
+
+      poison(Q, N, recvs);
+
+      std::vector<unsigned long> rank_times;
+      auto *p_rank_times = per_rank ? &rank_times : nullptr;
+      const auto time = (transfer == "isend")
+                            ? datatransfer(Q, N, sends, recvs, num_warmup, num_iteration, 1,
+                                           {MPI_COMM_WORLD}, p_rank_times)
+                            : datatransfer_win(transfer, w, Q, N, sends, recvs, num_warmup,
+                                               num_iteration, p_rank_times);
+      if (world_rank == 0) {
+        const double bw = (1. * (bidirectional ? 2 : 1) * N_byte * num_pair) / time;
+        std::cout << std::setw(16) << N_byte << " | " << std::setw(13) << (1E-3) * time << " | "
+                  << std::setw(16) << bw << std::endl;
+        if (per_rank) {
+          std::cout << "                   Per rank (us):";
+          for (auto t : rank_times)
+            std::cout << " " << (1E-3) * t;
+          std::cout << std::endl;
+        }
+      }
+    }
+  }
+}
+
+// Same pairs as `sweep` with isend, each transfer striped in K concurrent chunks for every K of
+// `stripes` (with one duplicated communicator per chunk if `dup`). One line per size and K, the
+// gain is relative to the first K
+void striping(std::string label, sycl::queue Q, float *a_gpu, float *b_gpu,
+              std::vector<int> stripes, bool dup, size_t min_bytes, size_t max_bytes,
+              int num_warmup, int num_iteration) {
+  int world_size, world_rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  const int num_pair = world_size / 2;
+  const int peer = (world_rank % 2 == 0) ? world_rank + 1 : world_rank - 1;
+  const bool has_peer = peer < world_size;
+
+  std::vector<MPI_Comm> comms = {MPI_COMM_WORLD};
+  if (dup) {
+    comms.resize(*std::max_element(stripes.begin(), stripes.end()));
+    for (auto &comm : comms)
+      MPI_Comm_dup(MPI_COMM_WORLD, &comm);
+  }
+
+  for (const bool bidirectional : {false, true}) {
+    if (world_rank == 0)
+      std::cout << "# " << label << " | isend | Striping" << (dup ? " (dup)" : "") << " | "
+                << (bidirectional ? "Bidirectional" : "Unidirectional") << "\n"
+                << "           Bytes |  Stripes |     Chunk bytes |  Latency (us) | "
+                   "Bandwidth (GB/s) |  Gain"
+                << std::endl;
+    for (size_t bytes = min_bytes; bytes <= max_bytes; bytes *= 2) {
+      const int N = std::max<size_t>(1, bytes / sizeof(float));
+      const size_t N_byte = N * sizeof(float);
+      std::vector<std::pair<int, float *>> sends;
+      std::vector<std::pair<int, float *>> recvs;
+      if (has_peer && (bidirectional || world_rank % 2 == 0)) {
+        fill_pattern(Q, N, a_gpu, world_rank);
+        sends.push_back({peer, a_gpu});
+      }
+      if (has_peer && (bidirectional || world_rank % 2 == 1))
+        recvs.push_back({peer, b_gpu});
+
+      double reference_bw = 0;
+      for (const int K : stripes) {
+        // Chunks of at least one element
+        if (K > N)
+          continue;
+        poison(Q, N, recvs);
+        const auto time = datatransfer(Q, N, sends, recvs, num_warmup, num_iteration, K, comms);
+        if (world_rank == 0) {
+          const double bw = (1. * (bidirectional ? 2 : 1) * N_byte * num_pair) / time;
+          if (!reference_bw)
+            reference_bw = bw;
+          std::cout << std::setw(16) << N_byte << " | " << std::setw(8) << K << " | "
+                    << std::setw(15) << N_byte / K << " | " << std::setw(13) << (1E-3) * time
+                    << " | " << std::setw(16) << bw << " | " << std::setw(5) << std::setprecision(3)
+                    << bw / reference_bw << std::setprecision(6) << std::endl;
+        }
+      }
+    }
+  }
+
+  if (dup)
+    for (auto &comm : comms)
+      MPI_Comm_free(&comm);
+}
+
+// Flows (source, destination) of a traffic `pattern` between `n` ranks, the same on every rank:
+//   shift:<k>: i -> i + k (mod n)
+//   permutation: i -> p(i), a random permutation (seeded, without the fixed points)
+//   incast: every rank -> 0
+//   alltoall: every rank -> every other one
+//   bisection: the k-th rank of the side 0 <-> the k-th rank of the side 1 (`sides`)
+std::vector<std::pair<int, int>> traffic_flows(std::string pattern, int n,
+                                               const std::vector<int> &sides) {
+  std::vector<std::pair<int, int>> flows;
+  if (pattern.rfind("shift:", 0) == 0) {
+    const int k = std::stoi(pattern.substr(6));
+    for (int i = 0; i < n; i++)
+      if (((i + k) % n + n) % n != i)
+        flows.push_back({i, ((i + k) % n + n) % n});
+  } else if (pattern == "permutation") {
+    std::vector<int> p(n);
+    std::iota(p.begin(), p.end(), 0);
+    std::shuffle(p.begin(), p.end(), std::minstd_rand{});
+    for (int i = 0; i < n; i++)
+      if (p[i] != i)
+        flows.push_back({i, p[i]});
+  } else if (pattern == "incast") {
+    for (int i = 1; i < n; i++)
+      flows.push_back({i, 0});
+  } else if (pattern == "alltoall") {
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < n; j++)
+        if (i != j)
+          flows.push_back({i, j});
+  } else if (pattern == "bisection") {
+    std::vector<int> side[2];
+    for (int i = 0; i < n; i++)
+      side[sides[i]].push_back(i);
+    for (size_t k = 0; k < std::min(side[0].size(), side[1].size()); k++) {
+      flows.push_back({side[0][k], side[1][k]});
+      flows.push_back({side[1][k], side[0][k]});
+    }
+  }
+  return flows;
+}
+
+// Side (0 or 1) of every rank for the bisection. With `planes_path`, the output of `./topology`
+// (one plane of "<gpu>.<subdevice>" per line): the tile of a rank is its ZE_AFFINITY_MASK or
+// ONEAPI_DEVICE_SELECTOR (as set by `tile_mapping.sh`), the first half of the planes is the
+// side 0. Otherwise, or if one side is empty, the first half of the ranks
+std::vector<int> bisection_sides(std::string planes_path) {
+  int world_size, world_rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+
+  int plane = -1, num_planes = 0;
+  if (!planes_path.empty()) {
+    std::string tile;
+    if (const char *mask = std::getenv("ZE_AFFINITY_MASK"))
+      tile = mask;
+    else if (const char *selector = std::getenv("ONEAPI_DEVICE_SELECTOR"))
+      tile = std::string(selector).substr(std::string(selector).find(':') + 1);
+    std::ifstream in(planes_path);
+    for (std::string line; std::getline(in, line); num_planes++) {
+      std::stringstream ss(line);
+      for (std::string id; ss >> id;)
+        if (id == tile)
+          plane = num_planes;
+    }
+  }
+  std::vector<int> sides(world_size);
+  const int side = (plane == -1) ? -1 : (2 * plane >= num_planes);
+  MPI_Allgather(&side, 1, MPI_INT, sides.data(), 1, MPI_INT, MPI_COMM_WORLD);
+
+  const auto n_side_1 = std::count(sides.begin(), sides.end(), 1);
+  if (std::count(sides.begin(), sides.end(), -1) || n_side_1 == 0 || n_side_1 == world_size) {
+    if (!planes_path.empty() && world_rank == 0)
+      std::cerr << "WARNING: Ranks not split across the planes of '" << planes_path
+                << "', bisection between the halves of the ranks" << std::endl;
+    for (int i = 0; i < world_size; i++)
+      sides[i] = 2 * i >= world_size;
+  }
+  return sides;
+}
+
+// All the flows of `pattern` at once, `N` floats each. Returns the minimum time (ns) of the
+// whole pattern, `flow_times` are the times of the flows received by this rank (from the first
+// start to the completion of their MPI_Irecv) in that iteration
+unsigned long datatransfer_flows(sycl::queue Q, int N, std::vector<std::pair<int, float *>> &sends,
+                                 std::vector<std::pair<int, float *>> &recvs, int num_warmup,
+                                 int num_iteration, std::vector<unsigned long> &flow_times) {
+  unsigned long min_time = std::numeric_limits<unsigned long>::max();
+  std::vector<unsigned long> ends(recvs.size());
+
+  for (int r = -num_warmup; r < num_iteration; r++) {
+    MPI_Barrier(MPI_COMM_WORLD);
+    const unsigned long l_start =
+        std::chrono::high_resolution_clock::now().time_since_epoch().count();
+
+    // Receives first, their index is the flow
+    std::vector<MPI_Request> requests;
+    for (auto &[src, ptr] : recvs) {
+      requests.push_back(MPI_REQUEST_NULL);
+      MPI_Irecv(ptr, N, MPI_FLOAT, src, 0, MPI_COMM_WORLD, &requests.back());
+    }
+    for (auto &[dest, ptr] : sends) {
+      requests.push_back(MPI_REQUEST_NULL);
+      MPI_Isend(ptr, N, MPI_FLOAT, dest, 0, MPI_COMM_WORLD, &requests.back());
+    }
+    for (size_t i = 0; i < requests.size(); i++) {
+      int index;
+      MPI_Waitany(requests.size(), requests.data(), &index, MPI_STATUS_IGNORE);
+      if (index != MPI_UNDEFINED && index < static_cast<int>(recvs.size()))
+        ends[index] = clock_model.global(
+            std::chrono::high_resolution_clock::now().time_since_epoch().count());
+    }
+
+    const unsigned long l_end =
+        std::chrono::high_resolution_clock::now().time_since_epoch().count();
+    // All the ranks know the best iteration, and the global start
+    const unsigned long time = global_time(l_start, l_end);
+    const unsigned long g_start = clock_model.global(l_start);
+    unsigned long start;
+    MPI_Allreduce(&g_start, &start, 1, MPI_UNSIGNED_LONG, MPI_MIN, MPI_COMM_WORLD);
+    if (r >= 0 && time < min_time) {
+      min_time = time;
+      flow_times.clear();
+      for (auto end : ends)
+        flow_times.push_back(end - start);
+    }
+  }
+
+  verify(Q, N, recvs);
+
+  return min_time;
+}
+
+// Every flow of `pattern` at once (isend), each one received in its own buffer. One line per
+// size: time of the whole pattern, aggregate bandwidth, and min/mean/max bandwidth of the flows
+void traffic(std::string label, std::string pattern, sycl::queue Q, float *a_gpu,
+             std::string memory, const std::vector<int> &sides, size_t min_bytes,
+             size_t max_bytes, int num_warmup, int num_iteration) {
+  int world_size, world_rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  const auto flows = traffic_flows(pattern, world_size, sides);
+
+  std::vector<int> dests, srcs;
+  for (auto &[src, dest] : flows) {
+    if (src == world_rank)
+      dests.push_back(dest);
+    if (dest == world_rank)
+      srcs.push_back(src);
+  }
+  const size_t N_max = std::max<size_t>(1, max_bytes / sizeof(float));
+  const size_t N_recv = std::max<size_t>(1, N_max * srcs.size());
+  auto *r_gpu = (memory == "device") ? sycl::malloc_device<float>(N_recv, Q)
+                                     : sycl::malloc_host<float>(N_recv, Q);
+
+  if (world_rank == 0)
+    std::cout << "# " << label << " | isend | " << pattern << " (" << flows.size() << " flows)\n"
+              << "           Bytes |  Latency (us) | Bandwidth (GB/s) |  Flow min (GB/s) | "
+                 "Flow mean (GB/s) |  Flow max (GB/s)"
+              << std::endl;
+  for (size_t bytes = min_bytes; bytes <= max_bytes; bytes *= 2) {
+    const int N = std::max<size_t>(1, bytes / sizeof(float));
+    const size_t N_byte = N * sizeof(float);
+    std::vector<std::pair<int, float *>> sends;
+    std::vector<std::pair<int, float *>> recvs;
+    fill_pattern(Q, N, a_gpu, world_rank);
+    for (auto dest : dests)
+      sends.push_back({dest, a_gpu});
+    for (size_t i = 0; i < srcs.size(); i++)
+      recvs.push_back({srcs[i], r_gpu + i * N_max});
+
+    poison(Q, N, recvs);
+
+    std::vector<unsigned long> flow_times;
+    const auto time =
+        datatransfer_flows(Q, N, sends, recvs, num_warmup, num_iteration, flow_times);
+
+    double l_flows[3] = {std::numeric_limits<double>::max(), 0, 0}; // min, sum, -max
+    for (auto t : flow_times) {
+      const double bw = (1. * N_byte) / t;
+      l_flows[0] = std::min(l_flows[0], bw);
+      l_flows[1] += bw;
+      l_flows[2] = std::min(l_flows[2], -bw);
+    }
+    double min_flows[3], sum_flows[3];
+    MPI_Reduce(l_flows, min_flows, 3, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+    MPI_Reduce(l_flows, sum_flows, 3, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (world_rank == 0) {
+      const double bw = (1. * N_byte * flows.size()) / time;
+      const double mean = flows.empty() ? 0 : sum_flows[1] / flows.size();
+      std::cout << std::setw(16) << N_byte << " | " << std::setw(13) << (1E-3) * time << " | "
+                << std::setw(16) << bw << " | " << std::setw(16)
+                << (flows.empty() ? 0 : min_flows[0]) << " | " << std::setw(16) << mean << " | "
+                << std::setw(16) << -min_flows[2] << std::endl;
+    }
+  }
+  sycl::free(r_gpu, Q);
+}
+
+// One line per size: percentiles of the samples, the worst pair is reported
+void latency(std::string label, std::string transfer, char *ptr, const window_t &w,
+             size_t min_bytes, size_t max_bytes, int num_warmup, int num_iteration) {
+  int world_size, world_rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  const int peer = (world_rank % 2 == 0) ? world_rank + 1 : world_rank - 1;
+  const bool has_peer = peer < world_size;
+
+  if (world_rank == 0)
+    std::cout << "# " << label << " | " << transfer << " | Latency\n"
+              << "           Bytes |      p50 (us) |      p99 (us) |      max (us)" << std::endl;
+  for (size_t bytes = min_bytes; bytes <= max_bytes; bytes *= 2) {
+    std::vector<unsigned long> samples;
+    if (transfer != "isend")
+      samples = has_peer
+                    ? pingpong_win(transfer, w, ptr, bytes, peer, num_warmup, num_iteration)
+                    : pingpong_win(transfer, w, ptr, 0, MPI_PROC_NULL, 0, 0);
+    else if (has_peer)
+      samples = pingpong(ptr, bytes, peer, world_rank % 2 == 0, num_warmup, num_iteration);
+    else
+      MPI_Barrier(MPI_COMM_WORLD);
+
+    unsigned long l_percentiles[3] = {0, 0, 0}, percentiles[3];
+    if (!samples.empty()) {
+      std::sort(samples.begin(), samples.end());
+      const size_t n = samples.size();
+      l_percentiles[0] = samples[(n - 1) / 2];
+      l_percentiles[1] = samples[std::min(n - 1, (99 * n + 99) / 100 - 1)];
+      l_percentiles[2] = samples[n - 1];
+    }
+    MPI_Reduce(l_percentiles, percentiles, 3, MPI_UNSIGNED_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (world_rank == 0) {
+      std::cout << std::setw(16) << bytes;
+      for (auto p : percentiles)
+        std::cout << " | " << std::setw(13) << (1E-3) * p;
+      std::cout << std::endl;
+    }
+  }
+}
+
+// Partner of `rank` in the `round` of a round-robin tournament (circle method) between `n` ranks,
+// `n - 1` rounds (`n` if odd) where every rank meets every other one once. -1 for a bye
+int tournament_partner(int rank, int round, int n) {
+  const int m = n + n % 2; // A phantom rank for the byes
+  int partner;
+  if (rank == m - 1)
+    partner = round;
+  else if (rank == round)
+    partner = m - 1;
+  else
+    partner = (2 * round - rank + 2 * (m - 1)) % (m - 1);
+  return (partner < n) ? partner : -1;
+}
+
+// Minimum time (ns) to send `bytes` to `peer` and get back its zero-byte acknowledgment
+unsigned long oneway(char *send, char *recv, size_t bytes, int peer, bool sender, int num_warmup,
+                     int num_iteration) {
+  unsigned long min_time = std::numeric_limits<unsigned long>::max();
+  for (int r = -num_warmup; r < num_iteration; r++) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    if (sender) {
+      MPI_Send(send, bytes, MPI_BYTE, peer, 0, MPI_COMM_WORLD);
+      MPI_Recv(nullptr, 0, MPI_BYTE, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    } else {
+      MPI_Recv(recv, bytes, MPI_BYTE, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+      MPI_Send(nullptr, 0, MPI_BYTE, peer, 0, MPI_COMM_WORLD);
+    }
+    const auto end = std::chrono::high_resolution_clock::now();
+    if (r >= 0)
+      min_time = std::min<unsigned long>(
+          min_time, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+  }
+  return min_time;
+}
+
+// Every (i, j) pair, one round of the tournament at a time so the pairs of a round are disjoint.
+// Bandwidth (GB/s) of `bw_bytes` messages from i to j, and p50 half round-trip (us) of
+// `lat_bytes` ping-pongs. Rank 0 writes the NxN matrices in `<prefix>_{bandwidth,latency}.csv`
+void all_pairs(std::string prefix, char *send, char *recv, size_t bw_bytes, size_t lat_bytes,
+               int num_warmup, int num_iteration) {
+  int world_size, world_rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  std::vector<double> bandwidths(world_size, 0), latencies(world_size, 0);
+
+  const int n_rounds = world_size - 1 + world_size % 2;
+  for (int round = 0; round < n_rounds; round++) {
+    const int peer = tournament_partner(world_rank, round, world_size);
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (peer != -1) {
+      // Both directions, the lower rank first
+      for (const bool sender : {world_rank < peer, world_rank > peer}) {
+        const auto time = oneway(send, recv, bw_bytes, peer, sender, num_warmup, num_iteration);
+        if (sender)
+          bandwidths[peer] = (1. * bw_bytes) / time;
+      }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (peer != -1) {
+      // Symmetric, measured by the lower rank only
+      auto samples = pingpong(send, lat_bytes, peer, world_rank < peer, num_warmup, num_iteration);
+      std::sort(samples.begin(), samples.end());
+      if (!samples.empty())
+        latencies[peer] = (1E-3) * samples[(samples.size() - 1) / 2];
+    } else {
+      MPI_Barrier(MPI_COMM_WORLD); // The one of `pingpong`
+    }
+  }
+
+  std::vector<double> all_bandwidths(world_size * world_size);
+  std::vector<double> all_latencies(world_size * world_size);
+  MPI_Gather(bandwidths.data(), world_size, MPI_DOUBLE, all_bandwidths.data(), world_size,
+             MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Gather(latencies.data(), world_size, MPI_DOUBLE, all_latencies.data(), world_size,
+             MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  if (world_rank != 0)
+    return;
+  for (int i = 0; i < world_size; i++)
+    for (int j = 0; j < i; j++)
+      all_latencies[i * world_size + j] = all_latencies[j * world_size + i];
+  for (const auto &[name, matrix] : {std::make_pair("bandwidth", &all_bandwidths),
+                                     std::make_pair("latency", &all_latencies)}) {
+    const auto path = prefix + "_" + name + ".csv";
+    std::ofstream out(path);
+    out << "rank";
+    for (int j = 0; j < world_size; j++)
+      out << "," << j;
+    out << "\n";
+    for (int i = 0; i < world_size; i++) {
+      out << i;
+      for (int j = 0; j < world_size; j++) {
+        out << ",";
+        if (i != j)
+          out << (*matrix)[i * world_size + j];
+      }
+      out << "\n";
+    }
+    std::cout << "# " << prefix << " | " << name << " matrix written to " << path << std::endl;
+  }
+}
+
 int main(int argc, char *argv[]) {
 
-  std::string mode = (argc == 1) ? "Tile2Tile" : argv[1];
   MPI_Init(NULL, NULL);
   int world_size, world_rank;
   MPI_Comm_size(MPI_COMM_WORLD, &world_size);
   MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
 
-  int num_pair = world_size / 2;
-
-  sycl::queue Q(sycl::gpu_selector_v);
-  const int N = 1179648 * 40; // 1 << 25;
-  const int N_byte = N * sizeof(float);
-  auto *a_gpu = sycl::malloc_device<float>(N, Q);
-
-#ifdef USE_WIN
-  MPI_Win win;
-  MPI_Win_create(a_gpu, N_byte, sizeof(float), MPI_INFO_NULL, MPI_COMM_WORLD, &win);
-#endif
-  std::vector<std::pair<int, float *>> sends;
-  std::vector<std::pair<int, float *>> recvs;
-
-  if (world_rank % 2 == 0) {
-    fill_randomly(Q, N, {a_gpu});
-    sends.push_back({world_rank + 1, a_gpu});
-  } else
-    recvs.push_back({world_rank - 1, a_gpu});
-
-#ifdef USE_WIN
-  auto unitime = datatransfer_win(win, Q, N, sends, recvs);
-#else
-  auto unitime = datatransfer(Q, N, sends, recvs);
-#endif
-  if (world_rank == 0) {
-    const double unitime_bw = (N_byte * num_pair) / unitime;
-    std::cout << mode << " Unidirectional Bandwidth: " << unitime_bw << " GB/s" << std::endl;
-  }
-  if (world_rank % 2 == 0)
-    recvs.push_back({world_rank + 1, a_gpu});
-  else {
-    fill_randomly(Q, N, {a_gpu});
-    sends.push_back({world_rank - 1, a_gpu});
-  }
-#ifdef USE_WIN
-  auto bitime = datatransfer_win(win, Q, N, sends, recvs);
-#else
-  auto bitime = datatransfer(Q, N, sends, recvs);
-#endif
-  if (world_rank == 0) {
-    const double bitime_bw = (2L * N_byte * num_pair) / bitime;
-    std::cout << mode << " Bidirectional Bandwidth: " << bitime_bw << " GB/s" << std::endl;
+  std::string label = "Tile2Tile";
+  std::string device_selector = "gpu";
+  std::string transfer = "isend";
+  std::string memory = "device";
+  std::string window = "create";
+  bool is_pingpong = false;
+  std::string all_pairs_prefix;
+  std::vector<int> stripes;
+  std::vector<std::string> patterns;
+  std::string planes_path;
+  int num_fitpoints = 10;
+  bool per_rank = false;
+  bool stripe_dup = false;
+  // '0' mean the default of the mode
+  size_t min_bytes = 0;
+  size_t max_bytes = 0;
+  int num_warmup = -1;
+  int num_iteration = 0;
+  for (int i = 1; i < argc; i++) {
+    std::string s{argv[i]};
+    const bool has_value = i + 1 < argc;
+    if (s == "--device" && has_value)
+      device_selector = argv[++i];
+    else if (s == "--transfer" && has_value)
+      transfer = argv[++i];
+    else if (s == "--memory" && has_value)
+      memory = argv[++i];
+    else if (s == "--window" && has_value)
+      window = argv[++i];
+    else if (s == "--pingpong")
+      is_pingpong = true;
+    else if (s == "--all_pairs" && has_value)
+      all_pairs_prefix = argv[++i];
+    else if (s == "--stripes" && has_value) {
+      std::stringstream ss(argv[++i]);
+      for (std::string k; std::getline(ss, k, ',');)
+        stripes.push_back(std::stoi(k));
+    } else if (s == "--stripe_comms")
+      stripe_dup = true;
+    else if (s == "--pattern" && has_value) {
+      std::stringstream ss(argv[++i]);
+      for (std::string p; std::getline(ss, p, ',');)
+        patterns.push_back(p);
+    } else if (s == "--planes" && has_value)
+      planes_path = argv[++i];
+    else if (s == "--clock_sync" && has_value)
+      num_fitpoints = std::stoi(argv[++i]);
+    else if (s == "--per_rank")
+      per_rank = true;
+    else if (s == "--verify_host")
+      verify_on_host = true;
+    else if (s == "--min_bytes" && has_value)
+      min_bytes = std::stoul(argv[++i]);
+    else if (s == "--max_bytes" && has_value)
+      max_bytes = std::stoul(argv[++i]);
+    else if (s == "--warmup" && has_value)
+      num_warmup = std::stoi(argv[++i]);
+    else if (s == "--iterations" && has_value)
+      num_iteration = std::stoi(argv[++i]);
+    else if (s.rfind("-", 0) == 0)
+      print_help_and_exit(argv[0], "Unsupported option: '" + s + "'");
+    else
+      label = s;
+  }
+  if (!min_bytes)
+    min_bytes = is_pingpong ? 1 : sizeof(float);
+  if (!max_bytes)
+    max_bytes = is_pingpong ? 65536 : 1179648 * 40 * sizeof(float);
+  if (num_warmup == -1)
+    num_warmup = is_pingpong ? 100 : 2;
+  if (!num_iteration)
+    num_iteration = is_pingpong ? 1000 : 10;
+  const std::vector<std::string> transfers = {"isend",    "put", "put_lock",
+                                              "put_pscw", "get", "accumulate"};
+  if (transfer != "all" &&
+      std::find(transfers.begin(), transfers.end(), transfer) == transfers.end())
+    print_help_and_exit(argv[0], "Need to specify (isend | put | put_lock | put_pscw | get | "
+                                 "accumulate | all) for '--transfer'");
+  if (memory != "device" && memory != "host" && memory != "mpi" && memory != "all")
+    print_help_and_exit(argv[0], "Need to specify (device | host | mpi | all) for '--memory'");
+  if (window != "create" && window != "dynamic" && window != "all")
+    print_help_and_exit(argv[0], "Need to specify (create | dynamic | all) for '--window'");
+  for (const auto &p : patterns)
+    if (p.rfind("shift:", 0) != 0 && p != "permutation" && p != "incast" && p != "alltoall" &&
+        p != "bisection")
+      print_help_and_exit(argv[0], "Unsupported pattern: '" + p + "'");
+  if (std::any_of(stripes.begin(), stripes.end(), [](int k) { return k < 1; }))
+    print_help_and_exit(argv[0], "Need <k> > 0 for '--stripes'");
+  if (min_bytes > max_bytes || max_bytes > std::numeric_limits<int>::max() * sizeof(float) ||
+      num_iteration < 1)
+    print_help_and_exit(argv[0], "Need 0 < <min_bytes> <= <max_bytes> < 8 GB and "
+                                 "<n_iterations> > 0");
+
+  sycl::queue Q(select_device(device_selector));
+  const size_t N = std::max<size_t>(1, max_bytes / sizeof(float));
+  const auto sides = bisection_sides(planes_path);
+  clock_model = clock_sync(num_fitpoints, 20);
+  {
+    const double l_clock[2] = {std::abs(1E-3 * clock_model.offset),
+                               std::abs(1E6 * clock_model.drift)};
+    double clock[2];
+    MPI_Reduce(l_clock, clock, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (world_rank == 0 && num_fitpoints)
+      std::cout << "# Clock sync | max offset to rank 0: " << clock[0]
+                << " us | max drift: " << clock[1] << " ppm" << std::endl;
+  }
+
+  const bool is_rma = transfer != "isend" && all_pairs_prefix.empty();
+  for (const std::string m : {"device", "host", "mpi"}) {
+    if (memory != m && memory != "all")
+      continue;
+    // Sent from `a`, received in `b`, so the bidirectional exchange does not race.
+    // The `mpi` memory is the one of MPI_Win_allocate
+    float *ab = nullptr;
+    if (m != "mpi")
+      ab = (m == "host") ? sycl::malloc_host<float>(2 * N, Q)
+                         : sycl::malloc_device<float>(2 * N, Q);
+
+    std::vector<std::string> windows;
+    for (const std::string w : {"create", "dynamic"})
+      if (window == w || window == "all")
+        windows.push_back(w);
+    if (m == "mpi")
+      windows = {"allocate"};
+
+    for (const auto &w : windows) {
+      const bool first = w == windows.front();
+      window_t win;
+      if (is_rma || m == "mpi")
+        win = window_open(w, ab, N);
+      auto *a_gpu = ab;
+      auto *b_gpu = ab + N;
+
+      if (!all_pairs_prefix.empty() && first)
+        all_pairs(all_pairs_prefix + "_" + m, reinterpret_cast<char *>(a_gpu),
+                  reinterpret_cast<char *>(b_gpu), max_bytes, min_bytes, num_warmup,
+                  num_iteration);
+
+      for (const auto &t : transfers) {
+        if (!all_pairs_prefix.empty())
+          break;
+        if ((transfer != t && transfer != "all") || (t == "isend" && !first))
+          continue;
+        const auto label_m = label + " | " + m + ((t == "isend") ? "" : " | " + w);
+        if (is_pingpong)
+          latency(label_m, t, reinterpret_cast<char *>(a_gpu), win, min_bytes, max_bytes,
+                  num_warmup, num_iteration);
+        else if (t == "isend" && !patterns.empty())
+          for (const auto &p : patterns)
+            traffic(label_m, p, Q, a_gpu, m, sides, min_bytes, max_bytes, num_warmup,
+                    num_iteration);
+        else if (t == "isend" && !stripes.empty())
+          striping(label_m, Q, a_gpu, b_gpu, stripes, stripe_dup, min_bytes, max_bytes,
+                   num_warmup, num_iteration);
+        else
+          sweep(label_m, t, Q, a_gpu, b_gpu, win, min_bytes, max_bytes, num_warmup,
+                num_iteration, per_rank);
+      }
+      window_close(w, win, ab);
+    }
+    if (m != "mpi")
+      sycl::free(ab, Q);
   }
+  MPI_Finalize();
 }
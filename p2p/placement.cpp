@@ -0,0 +1,304 @@
+#include "topology.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Rank to tile placement from files only: a communication pattern between the ranks and a
+// bandwidth between the tiles (measured by `peer2pear --all_pairs`, or derived from the hops of a
+// `topology --json` file). Minimizes sum over rank pairs of volume(i, j) / bandwidth(tile(i),
+// tile(j)): greedy placement of the heaviest pairs on the fastest links, then pairwise swaps
+// (with the free tiles too) until no improvement, from several seeded starts.
+//
+// Build: c++ -std=c++17 -O2 placement.cpp -o placement
+
+using matrix_t = std::vector<std::vector<double>>;
+
+void print_help_and_exit(std::string binname, std::string msg) {
+  if (!msg.empty())
+    std::cerr << "ERROR: " << msg << std::endl;
+  std::cerr << "Usage: " << binname
+            << " --ranks <n> [--pattern <pattern>] [--bandwidth <csv>] [--topology <json>]\n"
+               "           [--tiles <tile,...>] [--restarts <n>] [--output <file>]\n"
+               "\n"
+               "--ranks        Number of ranks, at most the number of tiles\n"
+               "--pattern      [default: pairs]. Volume between the ranks [possible values:\n"
+               "                 pairs (i <-> i^1, as peer2pear), ring (i <-> i+1), <csv> (NxN "
+               "matrix)]\n"
+               "--bandwidth    NxN bandwidth between the tiles (e.g. <prefix>_device_bandwidth.csv "
+               "of\n"
+               "                 peer2pear --all_pairs)\n"
+               "--topology     File of 'topology --json'. Names the tiles, and without "
+               "--bandwidth the\n"
+               "                 bandwidth is 1 / hops\n"
+               "--tiles        Names of the tiles of the --bandwidth rows [default: the ones "
+               "of --topology,\n"
+               "                 or the compact mapping of tile_mapping.sh: 0.0,0.1,1.0,...]\n"
+               "--restarts     [default: 16]. Seeded random starts of the local search, besides "
+               "the greedy one\n"
+               "--output       Write the placement in a file for 'tile_mapping.sh placement' "
+               "[default: stdout]\n"
+               "\n"
+               "CSV matrices: numbers separated by ',', with an optional header row and label "
+               "column\n"
+               "(as written by peer2pear). Empty cells are 0\n";
+  std::exit(1);
+}
+
+// A header row and a label column are dropped when the first cell is not a number
+matrix_t read_csv(const std::string &path) {
+  std::ifstream in(path);
+  if (!in)
+    print_help_and_exit("placement", "Cannot read '" + path + "'");
+  std::vector<std::vector<std::string>> cells;
+  for (std::string line; std::getline(in, line);) {
+    if (line.empty())
+      continue;
+    std::vector<std::string> row;
+    std::stringstream ss(line);
+    for (std::string cell; std::getline(ss, cell, ',');)
+      row.push_back(cell);
+    if (line.back() == ',')
+      row.push_back("");
+    cells.push_back(row);
+  }
+  const auto is_number = [](const std::string &s) {
+    char *end;
+    std::strtod(s.c_str(), &end);
+    return !s.empty() && *end == '\0';
+  };
+  const bool labeled = !cells.empty() && !cells[0].empty() && !is_number(cells[0][0]);
+  matrix_t m;
+  for (size_t i = labeled; i < cells.size(); i++) {
+    m.push_back({});
+    for (size_t j = labeled; j < cells[i].size(); j++)
+      m.back().push_back(cells[i][j].empty() ? 0 : std::stod(cells[i][j]));
+  }
+  for (auto &row : m)
+    if (row.size() != m.size())
+      print_help_and_exit("placement", "'" + path + "' is not a square matrix");
+  return m;
+}
+
+// Volume between the ranks, symmetric
+matrix_t pattern_volumes(const std::string &pattern, int n) {
+  matrix_t w(n, std::vector<double>(n, 0));
+  if (pattern == "pairs") {
+    for (int i = 0; i + 1 < n; i += 2)
+      w[i][i + 1] = w[i + 1][i] = 1;
+  } else if (pattern == "ring") {
+    for (int i = 0; i < n && n > 1; i++)
+      w[i][(i + 1) % n] = w[(i + 1) % n][i] = 1;
+  } else {
+    const auto m = read_csv(pattern);
+    if (static_cast<int>(m.size()) != n)
+      print_help_and_exit("placement", "'" + pattern + "' is not a " + std::to_string(n) + "x" +
+                                           std::to_string(n) + " matrix");
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < n; j++)
+        if (i != j)
+          w[i][j] = m[i][j] + m[j][i];
+  }
+  return w;
+}
+
+// Time of the pattern, up to a constant. Unreachable tiles cost a lot, but stay comparable
+double cost(const matrix_t &w, const matrix_t &b, const std::vector<int> &tile_of) {
+  double c = 0;
+  for (size_t i = 0; i < w.size(); i++)
+    for (size_t j = i + 1; j < w.size(); j++)
+      if (w[i][j])
+        c += w[i][j] / std::max(b[tile_of[i]][tile_of[j]], 1E-9);
+  return c;
+}
+
+// Pairwise swaps of the tiles of two ranks, or of a rank and a free tile, while it improves
+double local_search(const matrix_t &w, const matrix_t &b, std::vector<int> &tiles) {
+  // `tiles`: the first ranks are placed on the first tiles, the others are free
+  std::vector<int> tile_of(tiles.begin(), tiles.begin() + w.size());
+  double best = cost(w, b, tile_of);
+  for (bool improved = true; improved;) {
+    improved = false;
+    for (size_t i = 0; i < w.size(); i++)
+      for (size_t j = i + 1; j < tiles.size(); j++) {
+        std::swap(tiles[i], tiles[j]);
+        tile_of.assign(tiles.begin(), tiles.begin() + w.size());
+        const double c = cost(w, b, tile_of);
+        if (c < best - 1E-12 * best) {
+          best = c;
+          improved = true;
+        } else {
+          std::swap(tiles[i], tiles[j]);
+        }
+      }
+  }
+  return best;
+}
+
+// Heaviest pairs first: both ranks unplaced go on the fastest free pair of tiles, one placed
+// rank gets the free tile fastest from it
+std::vector<int> greedy(const matrix_t &w, const matrix_t &b) {
+  const int n = w.size(), m = b.size();
+  std::vector<std::pair<int, int>> pairs;
+  for (int i = 0; i < n; i++)
+    for (int j = i + 1; j < n; j++)
+      pairs.push_back({i, j});
+  std::stable_sort(pairs.begin(), pairs.end(),
+                   [&](auto &p, auto &q) { return w[p.first][p.second] > w[q.first][q.second]; });
+  std::vector<int> tile_of(n, -1);
+  std::vector<bool> used(m, false);
+  const auto place = [&](int rank, int tile) {
+    tile_of[rank] = tile;
+    used[tile] = true;
+  };
+  for (auto &[i, j] : pairs) {
+    if (!w[i][j])
+      break;
+    if (tile_of[i] != -1 && tile_of[j] != -1)
+      continue;
+    if (tile_of[i] == -1 && tile_of[j] == -1) {
+      int best_s = -1, best_t = -1;
+      for (int s = 0; s < m; s++)
+        for (int t = 0; t < m; t++)
+          if (s != t && !used[s] && !used[t] &&
+              (best_s == -1 || b[s][t] > b[best_s][best_t]))
+            best_s = s, best_t = t;
+      if (best_s == -1)
+        break;
+      place(i, best_s);
+      place(j, best_t);
+    } else {
+      const int placed = (tile_of[i] != -1) ? i : j, other = i + j - placed;
+      int best_t = -1;
+      for (int t = 0; t < m; t++)
+        if (!used[t] && (best_t == -1 || b[tile_of[placed]][t] > b[tile_of[placed]][best_t]))
+          best_t = t;
+      place(other, best_t);
+    }
+  }
+  // Ranks without volume, and the free tiles after them
+  for (int i = 0; i < n; i++)
+    if (tile_of[i] == -1)
+      for (int t = 0; t < m; t++)
+        if (!used[t]) {
+          place(i, t);
+          break;
+        }
+  auto tiles = tile_of;
+  for (int t = 0; t < m; t++)
+    if (!used[t])
+      tiles.push_back(t);
+  return tiles;
+}
+
+int main(int argc, char **argv) {
+  int n_ranks = 0;
+  int n_restarts = 16;
+  std::string pattern = "pairs", bandwidth_path, topology_path, tiles_list, output_path;
+  for (int i = 1; i < argc; i++) {
+    const std::string s{argv[i]};
+    const bool has_value = i + 1 < argc;
+    if (s == "--ranks" && has_value)
+      n_ranks = std::atoi(argv[++i]);
+    else if (s == "--pattern" && has_value)
+      pattern = argv[++i];
+    else if (s == "--bandwidth" && has_value)
+      bandwidth_path = argv[++i];
+    else if (s == "--topology" && has_value)
+      topology_path = argv[++i];
+    else if (s == "--tiles" && has_value)
+      tiles_list = argv[++i];
+    else if (s == "--restarts" && has_value)
+      n_restarts = std::atoi(argv[++i]);
+    else if (s == "--output" && has_value)
+      output_path = argv[++i];
+    else
+      print_help_and_exit(argv[0], "Unsupported option: '" + s + "'");
+  }
+  if (bandwidth_path.empty() && topology_path.empty())
+    print_help_and_exit(argv[0], "Need '--bandwidth' or '--topology'");
+
+  topology_t topology;
+  if (!topology_path.empty()) {
+    topology = topology_load(topology_path);
+    if (topology.tiles.empty())
+      print_help_and_exit(argv[0], "No tile in '" + topology_path + "'");
+  }
+
+  // Bandwidth between the tiles, and their names
+  matrix_t b;
+  std::vector<std::string> tiles;
+  if (!bandwidth_path.empty()) {
+    b = read_csv(bandwidth_path);
+    // Measured in both directions, a pair is as fast as its slowest one
+    for (size_t s = 0; s < b.size(); s++)
+      for (size_t t = s + 1; t < b.size(); t++)
+        b[s][t] = b[t][s] = std::min(b[s][t], b[t][s]);
+    if (!tiles_list.empty()) {
+      std::stringstream ss(tiles_list);
+      for (std::string t; std::getline(ss, t, ',');)
+        tiles.push_back(t);
+    } else if (!topology_path.empty()) {
+      tiles = topology.tiles;
+    } else {
+      for (size_t k = 0; k < b.size(); k++)
+        tiles.push_back(std::to_string(k / 2) + "." + std::to_string(k % 2));
+    }
+    if (tiles.size() != b.size())
+      print_help_and_exit(argv[0], std::to_string(tiles.size()) + " tiles for a " +
+                                       std::to_string(b.size()) + "x" +
+                                       std::to_string(b.size()) + " bandwidth matrix");
+  } else {
+    tiles = topology.tiles;
+    const size_t m = tiles.size();
+    b.assign(m, std::vector<double>(m, 0));
+    for (size_t s = 0; s < m; s++)
+      for (size_t t = 0; t < m; t++) {
+        const int hops = topology_hops(topology, s, t);
+        b[s][t] = (s != t && hops > 0) ? 1. / hops : 0;
+      }
+  }
+  if (n_ranks < 1 || n_ranks > static_cast<int>(tiles.size()))
+    print_help_and_exit(argv[0], "Need 0 < <n> <= " + std::to_string(tiles.size()) +
+                                     " (the number of tiles) for '--ranks'");
+
+  const auto w = pattern_volumes(pattern, n_ranks);
+
+  // Identity (the order of the tiles) as the reference
+  std::vector<int> identity(tiles.size());
+  std::iota(identity.begin(), identity.end(), 0);
+  const double identity_cost =
+      cost(w, b, std::vector<int>(identity.begin(), identity.begin() + n_ranks));
+
+  auto best = greedy(w, b);
+  double best_cost = local_search(w, b, best);
+  std::minstd_rand g;
+  for (int r = 0; r < n_restarts; r++) {
+    auto start = identity;
+    std::shuffle(start.begin(), start.end(), g);
+    const double c = local_search(w, b, start);
+    if (c < best_cost - 1E-12 * best_cost) {
+      best_cost = c;
+      best = start;
+    }
+  }
+
+  std::stringstream sout;
+  sout << "# placement of " << n_ranks << " ranks, pattern " << pattern
+       << " | cost: " << best_cost << " (in order: " << identity_cost << ")\n";
+  for (int i = 0; i < n_ranks; i++)
+    sout << i << " ZE_AFFINITY_MASK=" << tiles[best[i]]
+         << " ONEAPI_DEVICE_SELECTOR=level_zero:" << tiles[best[i]] << "\n";
+  if (output_path.empty()) {
+    std::cout << sout.str();
+  } else {
+    std::ofstream out(output_path);
+    out << sout.str();
+    if (!out)
+      print_help_and_exit(argv[0], "Cannot write '" + output_path + "'");
+  }
+}
@@ -1,8 +1,8 @@
 #!/bin/bash -x
 
 icpx -lze_loader topology.cpp -o topology
-mpicxx -fsycl peer2pear.cpp -o peer2pear_i
-mpicxx -fsycl -DUSE_WIN peer2pear.cpp -o peer2pear_w
+mpicxx -fsycl peer2pear.cpp -o peer2pear
+icpx -std=c++17 placement.cpp -o placement
 
 export MPIR_CVAR_CH4_IPC_GPU_ENGINE_TYPE=copy_high_bandwidth
 
@@ -10,12 +10,28 @@ for mode in compact spread compact_plan
 do
   for affinity_metchanism in ZAM ODS 
   do
-    for bin in peer2pear_i peer2pear_w
+    for n in 2 12
     do
-      for n in 2 12
-      do 
-         mpirun -n $n -- ./tile_mapping.sh $mode $affinity_metchanism ./$bin "$bin $n $mode $affinity_metchanism"
-      done
+       mpirun -n $n -- ./tile_mapping.sh $mode $affinity_metchanism ./peer2pear "$n $mode $affinity_metchanism" --transfer all
     done
+    mpirun -n 2 -- ./tile_mapping.sh $mode $affinity_metchanism ./peer2pear "2 $mode $affinity_metchanism" --transfer all --window all --pingpong --memory all
   done
 done
+
+# Bandwidth and latency of every pair of tiles
+mpirun -n 12 -- ./tile_mapping.sh compact ZAM ./peer2pear --all_pairs all_pairs_12 --max_bytes 67108864
+
+# Gain of striping each transfer across concurrent requests
+mpirun -n 2 -- ./tile_mapping.sh spread ZAM ./peer2pear "2 spread ZAM" --stripes 1,2,4,8 --min_bytes 65536
+mpirun -n 2 -- ./tile_mapping.sh spread ZAM ./peer2pear "2 spread ZAM" --stripes 1,2,4,8 --stripe_comms --min_bytes 65536
+
+# Bandwidth under contention, the bisection is across the planes of ./topology
+ZES_ENABLE_SYSMAN=1 ./topology > planes.txt
+mpirun -n 12 -- ./tile_mapping.sh compact_plan ZAM ./peer2pear "12 compact_plan ZAM" --pattern shift:1,shift:6,permutation,incast,alltoall,bisection --planes planes.txt --max_bytes 16777216
+
+# Placement optimised for the pairs of peer2pear, from the measured bandwidth of every pair
+./placement --ranks 12 --pattern pairs --bandwidth all_pairs_12_device_bandwidth.csv --output placement.txt
+for affinity_metchanism in ZAM ODS
+do
+  mpirun -n 12 -- ./tile_mapping.sh placement $affinity_metchanism ./peer2pear "12 placement $affinity_metchanism" --transfer all
+done
@@ -17,6 +17,9 @@ elif [[ $1 == "spread" ]]; then
 elif [[ $1 == "compact_plan" ]]; then
   export ZES_ENABLE_SYSMAN=1
   mask=$(./topology $_MPI_RANKID)
+elif [[ $1 == "placement" ]]; then
+  # Written by ./placement --output
+  mask=$(awk -v rank=$_MPI_RANKID '$1 == rank { sub("ZE_AFFINITY_MASK=", "", $2); print $2 }' ${PLACEMENT_FILE:-placement.txt})
 fi
 shift;
 
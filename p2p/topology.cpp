@@ -1,107 +1,106 @@
+#include "topology.hpp"
 #include <cstdlib>
 #include <iostream>
-#include <level_zero/ze_api.h>
-#include <level_zero/zes_api.h>
-#include <set>
-#include <unordered_map>
-#include <vector>
+#ifndef NO_LEVEL_ZERO
+#include "topology_ze.hpp"
+#endif
 
-template <> struct std::hash<zes_fabric_port_id_t> {
-  std::size_t operator()(const zes_fabric_port_id_t &k) const {
-    // Compute individual hash values for first, second and third
-    // http://stackoverflow.com/a/1646913/126995
-    std::size_t res = 17;
-    res = res * 31 + hash<uint32_t>()(k.fabricId);
-    res = res * 31 + hash<uint32_t>()(k.attachId);
-    res = res * 31 + hash<uint8_t>()(k.portNumber);
-    return res;
-  }
-};
+// Build: icpx -lze_loader topology.cpp -o topology
+//        c++ -std=c++17 -DNO_LEVEL_ZERO topology.cpp -o topology  (only --mock, no hardware)
 
-bool operator==(const zes_fabric_port_id_t &lhs,
-                const zes_fabric_port_id_t &rhs) {
-  return lhs.fabricId == rhs.fabricId && lhs.attachId == rhs.attachId &&
-         lhs.portNumber == rhs.portNumber;
-};
-// Without arguments print plane connectivity (groups of GPU Tile direcly
-// connected) Is argment X is passed, print the X Tiles.
-int main(int argc, char **argv) {
-  zeInit(0);
+void print_help_and_exit(std::string binname, std::string msg) {
+  if (!msg.empty())
+    std::cerr << "ERROR: " << msg << std::endl;
+  std::cerr << "Usage: " << binname
+            << " [<X>] [--mock <file>] [--json <file>] [--dot <file>]\n"
+               "           [--plane <tile>] [--hops <tile> <tile>]\n"
+               "\n"
+               "Without arguments print plane connectivity (groups of GPU tiles directly "
+               "connected), one plane per line\n"
+               "<X>            Print the X-th tile, the planes one after the other (so pairs "
+               "are in the same\n"
+               "                 plane)\n"
+               "--mock         Read the topology from a file of --json instead of Level Zero "
+               "Sysman\n"
+               "--json         Write the topology as JSON ('-' for stdout)\n"
+               "--dot          Write the topology as a graphviz graph ('-' for stdout)\n"
+               "--plane        Print the plane of <tile>\n"
+               "--hops         Print the number of links between two tiles (tiles of a GPU are "
+               "one hop apart)\n"
+               "<tile>         <gpu>.<subdevice>, as ZE_AFFINITY_MASK\n";
+  std::exit(1);
+}
 
-  // Get devices
-  std::vector<zes_device_handle_t> hDevices;
-  {
-    uint32_t driverCount;
-    zeDriverGet(&driverCount, NULL);
-    std::vector<zes_driver_handle_t> hDrivers(driverCount);
-    zeDriverGet(&driverCount, hDrivers.data());
-    for (auto hDriver : hDrivers) {
-      uint32_t deviceCount;
-      zeDeviceGet(hDriver, &deviceCount, NULL);
-      int s = hDevices.size();
-      hDevices.resize(s + deviceCount);
-      zeDeviceGet(hDriver, &deviceCount, hDevices.data() + s);
-    }
+void write(const std::string &path, const std::string &text) {
+  if (path == "-") {
+    std::cout << text;
+    return;
   }
+  std::ofstream out(path);
+  out << text;
+  if (!out)
+    print_help_and_exit("topology", "Cannot write '" + path + "'");
+}
 
-  using d_sd_t = std::string;
-  using connection_t = std::set<d_sd_t>;
-
-  // Get Disjoint Connections
-  std::set<connection_t> disjoin_connections;
-  {
-    std::unordered_map<zes_fabric_port_id_t, connection_t> h;
-    for (int i = 0; i < hDevices.size(); i++) {
-      uint32_t numPorts;
-      zesDeviceEnumFabricPorts(hDevices[i], &numPorts, nullptr);
-      std::vector<zes_fabric_port_handle_t> hFabricPorts(numPorts);
-      zesDeviceEnumFabricPorts(hDevices[i], &numPorts, hFabricPorts.data());
-      for (auto &hPort : hFabricPorts) {
-        zes_fabric_port_properties_t hProperties;
-        zesFabricPortGetProperties(hPort, &hProperties);
-        std::string id =
-            std::to_string(i) + "." + std::to_string(hProperties.subdeviceId);
-        h[hProperties.portId].insert(id);
-
-        zes_fabric_port_state_t hState;
-        zesFabricPortGetState(hPort, &hState);
-        h[hState.remotePortId].insert(id);
-      }
-    }
-    for (auto &[_, v] : h)
-      disjoin_connections.insert(v);
+int main(int argc, char **argv) {
+  std::string mock_path, json_path, dot_path, plane_tile, index;
+  std::vector<std::string> hops_tiles;
+  for (int i = 1; i < argc; i++) {
+    const std::string s{argv[i]};
+    const bool has_value = i + 1 < argc;
+    if (s == "--mock" && has_value)
+      mock_path = argv[++i];
+    else if (s == "--json" && has_value)
+      json_path = argv[++i];
+    else if (s == "--dot" && has_value)
+      dot_path = argv[++i];
+    else if (s == "--plane" && has_value)
+      plane_tile = argv[++i];
+    else if (s == "--hops" && i + 2 < argc)
+      hops_tiles = {argv[i + 1], argv[i + 2]}, i += 2;
+    else if (s.rfind("-", 0) == 0)
+      print_help_and_exit(argv[0], "Unsupported option: '" + s + "'");
+    else
+      index = s;
   }
 
-  // Get Join Connections (assume fully connected plan)
-  std::vector<connection_t> connections;
-  {
-    for (auto &disjoin_connection : disjoin_connections) {
-      for (auto &connection : connections)
-        for (auto &dsd : disjoin_connection)
-          if (connection.count(dsd) != 0) {
-            connection.insert(disjoin_connection.begin(),
-                              disjoin_connection.end());
-            goto next;
-          }
-      connections.push_back(disjoin_connection);
-    next : {}
-    }
+  topology_t t;
+  if (!mock_path.empty()) {
+    t = topology_load(mock_path);
+    if (t.tiles.empty())
+      print_help_and_exit(argv[0], "No tile in '" + mock_path + "'");
+  } else {
+#ifdef NO_LEVEL_ZERO
+    print_help_and_exit(argv[0], "Built with -DNO_LEVEL_ZERO, '--mock' is required");
+#else
+    t = topology_discover();
+#endif
   }
 
+  if (!json_path.empty())
+    write(json_path, topology_to_json(t));
+  if (!dot_path.empty())
+    write(dot_path, topology_to_dot(t));
+  if (!plane_tile.empty())
+    std::cout << topology_plane(t, plane_tile) << std::endl;
+  if (!hops_tiles.empty())
+    std::cout << topology_hops(t, hops_tiles[0], hops_tiles[1]) << std::endl;
+  if (!json_path.empty() || !dot_path.empty() || !plane_tile.empty() || !hops_tiles.empty())
+    return 0;
+
   // Print Full Plan
-  if (argc < 2) {
-    for (auto &connection : connections) {
-      for (auto &d : connection)
-        std::cout << d << " ";
+  if (index.empty()) {
+    for (auto &plane : t.planes) {
+      for (auto i : plane)
+        std::cout << t.tiles[i] << " ";
       std::cout << std::endl;
     }
-  // Print ID in Plan (so pair are in the same plan)
+    // Print ID in Plan (so pair are in the same plan)
   } else {
-    std::vector<d_sd_t> flatten_connections;
-    for (auto &connection : connections)
-      flatten_connections.insert(flatten_connections.begin(),
-                                 connection.begin(), connection.end());
-
-    std::cout << flatten_connections[atoi(argv[1])] << std::endl;
+    const auto flatten = topology_flatten(t);
+    const size_t x = std::atoi(index.c_str());
+    if (x >= flatten.size())
+      print_help_and_exit(argv[0], "Only " + std::to_string(flatten.size()) + " tiles");
+    std::cout << flatten[x] << std::endl;
   }
 }
@@ -0,0 +1,221 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <numeric>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Fabric topology of the GPU tiles of a node: the tiles ("<gpu>.<subdevice>") and the links
+// between them. Found live from the Level Zero Sysman fabric ports (`topology_ze.hpp`), or loaded
+// from a file written by `topology_to_json` (mock backend, no hardware needed).
+//   planes: groups of tiles connected by links (connected components)
+//   hops: minimum number of links between two tiles, the tiles of one GPU are one hop apart
+// Both are precomputed by `make_topology`, the queries are constant time
+struct topology_t {
+  std::vector<std::string> tiles;
+  std::vector<std::pair<int, int>> links; // Indices in `tiles`
+  std::unordered_map<std::string, int> index;
+  std::vector<int> plane_of;
+  std::vector<std::vector<int>> planes;
+  std::vector<int> hop_matrix; // -1 when unreachable
+};
+
+// "<gpu>.<subdevice>" in numerical order, so "10.0" comes after "2.1"
+inline bool tile_less(const std::string &a, const std::string &b) {
+  const auto key = [](const std::string &t) {
+    const auto dot = t.find('.');
+    const bool numeric =
+        dot != std::string::npos && dot > 0 && dot + 1 < t.size() &&
+        std::count(t.begin(), t.end(), '.') == 1 &&
+        std::all_of(t.begin(), t.end(), [](char c) { return c == '.' || ::isdigit(c); });
+    return numeric ? std::make_pair(std::stol(t.substr(0, dot)), std::stol(t.substr(dot + 1)))
+                   : std::make_pair(-1L, -1L);
+  };
+  const auto ka = key(a), kb = key(b);
+  return (ka != kb) ? ka < kb : a < b;
+}
+
+inline std::string tile_gpu(const std::string &tile) { return tile.substr(0, tile.find('.')); }
+
+// Links are undirected, duplicated and self links are ignored. Tiles only named by the links are
+// added
+inline topology_t make_topology(std::vector<std::string> tiles,
+                                const std::vector<std::pair<std::string, std::string>> &links) {
+  for (auto &[a, b] : links) {
+    tiles.push_back(a);
+    tiles.push_back(b);
+  }
+  std::sort(tiles.begin(), tiles.end(), tile_less);
+  tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+
+  topology_t t;
+  t.tiles = tiles;
+  const int n = tiles.size();
+  for (int i = 0; i < n; i++)
+    t.index[tiles[i]] = i;
+  for (auto &[a, b] : links) {
+    const int i = std::min(t.index[a], t.index[b]), j = std::max(t.index[a], t.index[b]);
+    if (i != j)
+      t.links.push_back({i, j});
+  }
+  std::sort(t.links.begin(), t.links.end());
+  t.links.erase(std::unique(t.links.begin(), t.links.end()), t.links.end());
+
+  // Planes: union-find over the links, numbered by their first tile
+  std::vector<int> parent(n);
+  std::iota(parent.begin(), parent.end(), 0);
+  const auto find = [&](int i) {
+    while (parent[i] != i)
+      i = parent[i] = parent[parent[i]];
+    return i;
+  };
+  for (auto &[i, j] : t.links)
+    parent[std::max(find(i), find(j))] = std::min(find(i), find(j));
+  t.plane_of.assign(n, -1);
+  for (int i = 0; i < n; i++) {
+    const int root = find(i);
+    if (t.plane_of[root] == -1) {
+      t.plane_of[root] = t.planes.size();
+      t.planes.push_back({});
+    }
+    t.plane_of[i] = t.plane_of[root];
+    t.planes[t.plane_of[i]].push_back(i);
+  }
+
+  // Hops: one BFS per tile, over the links and between the tiles of a GPU
+  std::vector<std::vector<int>> neighbors(n);
+  for (auto &[i, j] : t.links) {
+    neighbors[i].push_back(j);
+    neighbors[j].push_back(i);
+  }
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      if (i != j && tile_gpu(tiles[i]) == tile_gpu(tiles[j]))
+        neighbors[i].push_back(j);
+  t.hop_matrix.assign(n * n, -1);
+  for (int s = 0; s < n; s++) {
+    int *hops = &t.hop_matrix[s * n];
+    std::queue<int> q;
+    hops[s] = 0;
+    for (q.push(s); !q.empty(); q.pop())
+      for (auto j : neighbors[q.front()])
+        if (hops[j] == -1) {
+          hops[j] = hops[q.front()] + 1;
+          q.push(j);
+        }
+  }
+  return t;
+}
+
+// -1 for an unknown tile
+inline int topology_index(const topology_t &t, const std::string &tile) {
+  const auto it = t.index.find(tile);
+  return (it == t.index.end()) ? -1 : it->second;
+}
+
+inline int topology_plane(const topology_t &t, const std::string &tile) {
+  const int i = topology_index(t, tile);
+  return (i == -1) ? -1 : t.plane_of[i];
+}
+
+inline int topology_hops(const topology_t &t, int i, int j) {
+  return t.hop_matrix[i * t.tiles.size() + j];
+}
+
+inline int topology_hops(const topology_t &t, const std::string &a, const std::string &b) {
+  const int i = topology_index(t, a), j = topology_index(t, b);
+  return (i == -1 || j == -1) ? -1 : topology_hops(t, i, j);
+}
+
+// The tiles of every plane, one plane after the other: consecutive tiles share a plane
+inline std::vector<std::string> topology_flatten(const topology_t &t) {
+  std::vector<std::string> flatten;
+  for (auto &plane : t.planes)
+    for (auto i : plane)
+      flatten.push_back(t.tiles[i]);
+  return flatten;
+}
+
+inline std::string topology_to_json(const topology_t &t) {
+  const auto quote = [](const std::string &s) { return "\"" + s + "\""; };
+  std::stringstream sout;
+  sout << "{\n  \"tiles\": [";
+  for (size_t i = 0; i < t.tiles.size(); i++)
+    sout << (i ? ", " : "") << quote(t.tiles[i]);
+  sout << "],\n  \"links\": [";
+  for (size_t l = 0; l < t.links.size(); l++)
+    sout << (l ? ", " : "") << "[" << quote(t.tiles[t.links[l].first]) << ", "
+         << quote(t.tiles[t.links[l].second]) << "]";
+  // Derived, only for the reader
+  sout << "],\n  \"planes\": [";
+  for (size_t p = 0; p < t.planes.size(); p++) {
+    sout << (p ? ", " : "") << "[";
+    for (size_t i = 0; i < t.planes[p].size(); i++)
+      sout << (i ? ", " : "") << quote(t.tiles[t.planes[p][i]]);
+    sout << "]";
+  }
+  sout << "]\n}\n";
+  return sout.str();
+}
+
+// One cluster per plane
+inline std::string topology_to_dot(const topology_t &t) {
+  std::stringstream sout;
+  sout << "graph topology {\n";
+  for (size_t p = 0; p < t.planes.size(); p++) {
+    sout << "  subgraph cluster_" << p << " {\n    label = \"plane " << p << "\";\n";
+    for (auto i : t.planes[p])
+      sout << "    \"" << t.tiles[i] << "\";\n";
+    sout << "  }\n";
+  }
+  for (auto &[i, j] : t.links)
+    sout << "  \"" << t.tiles[i] << "\" -- \"" << t.tiles[j] << "\";\n";
+  sout << "}\n";
+  return sout.str();
+}
+
+// String literals of the array following `"key":`, nested arrays flattened. Only the subset of
+// JSON written by `topology_to_json`
+inline std::vector<std::string> json_string_array(const std::string &text, const std::string &key) {
+  std::vector<std::string> strings;
+  auto pos = text.find("\"" + key + "\"");
+  if (pos == std::string::npos || (pos = text.find('[', pos)) == std::string::npos)
+    return strings;
+  for (int depth = 0; pos < text.size(); pos++) {
+    if (text[pos] == '[') {
+      depth++;
+    } else if (text[pos] == ']') {
+      if (--depth == 0)
+        break;
+    } else if (text[pos] == '"') {
+      const auto end = text.find('"', pos + 1);
+      if (end == std::string::npos)
+        break;
+      strings.push_back(text.substr(pos + 1, end - pos - 1));
+      pos = end;
+    }
+  }
+  return strings;
+}
+
+inline topology_t topology_from_json(const std::string &text) {
+  const auto tiles = json_string_array(text, "tiles");
+  const auto ends = json_string_array(text, "links");
+  std::vector<std::pair<std::string, std::string>> links;
+  for (size_t l = 0; l + 1 < ends.size(); l += 2)
+    links.push_back({ends[l], ends[l + 1]});
+  return make_topology(tiles, links);
+}
+
+// Mock backend. Empty topology if the file cannot be read
+inline topology_t topology_load(const std::string &path) {
+  std::ifstream in(path);
+  std::stringstream text;
+  text << in.rdbuf();
+  return in ? topology_from_json(text.str()) : topology_t{};
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "topology.hpp"
+#include <level_zero/ze_api.h>
+#include <level_zero/zes_api.h>
+#include <set>
+#include <unordered_map>
+
+// Live backend of `topology_t`: Level Zero Sysman fabric ports (needs ZES_ENABLE_SYSMAN=1)
+
+template <> struct std::hash<zes_fabric_port_id_t> {
+  std::size_t operator()(const zes_fabric_port_id_t &k) const {
+    // Compute individual hash values for first, second and third
+    // http://stackoverflow.com/a/1646913/126995
+    std::size_t res = 17;
+    res = res * 31 + hash<uint32_t>()(k.fabricId);
+    res = res * 31 + hash<uint32_t>()(k.attachId);
+    res = res * 31 + hash<uint8_t>()(k.portNumber);
+    return res;
+  }
+};
+
+inline bool operator==(const zes_fabric_port_id_t &lhs, const zes_fabric_port_id_t &rhs) {
+  return lhs.fabricId == rhs.fabricId && lhs.attachId == rhs.attachId &&
+         lhs.portNumber == rhs.portNumber;
+};
+
+// A port and its remote port share an id: the tiles found on the same id are linked
+inline topology_t topology_discover() {
+  zeInit(0);
+
+  // Get devices
+  std::vector<zes_device_handle_t> hDevices;
+  {
+    uint32_t driverCount = 0;
+    zeDriverGet(&driverCount, NULL);
+    std::vector<zes_driver_handle_t> hDrivers(driverCount);
+    zeDriverGet(&driverCount, hDrivers.data());
+    for (auto hDriver : hDrivers) {
+      uint32_t deviceCount = 0;
+      zeDeviceGet(hDriver, &deviceCount, NULL);
+      int s = hDevices.size();
+      hDevices.resize(s + deviceCount);
+      zeDeviceGet(hDriver, &deviceCount, hDevices.data() + s);
+    }
+  }
+
+  // Tiles of each port id
+  std::unordered_map<zes_fabric_port_id_t, std::set<std::string>> h;
+  std::vector<std::string> tiles;
+  for (size_t i = 0; i < hDevices.size(); i++) {
+    uint32_t numPorts = 0;
+    zesDeviceEnumFabricPorts(hDevices[i], &numPorts, nullptr);
+    std::vector<zes_fabric_port_handle_t> hFabricPorts(numPorts);
+    zesDeviceEnumFabricPorts(hDevices[i], &numPorts, hFabricPorts.data());
+    for (auto &hPort : hFabricPorts) {
+      zes_fabric_port_properties_t hProperties;
+      zesFabricPortGetProperties(hPort, &hProperties);
+      const std::string id = std::to_string(i) + "." + std::to_string(hProperties.subdeviceId);
+      tiles.push_back(id);
+      h[hProperties.portId].insert(id);
+
+      zes_fabric_port_state_t hState;
+      zesFabricPortGetState(hPort, &hState);
+      h[hState.remotePortId].insert(id);
+    }
+  }
+
+  std::vector<std::pair<std::string, std::string>> links;
+  for (auto &[_, connection] : h)
+    for (auto &a : connection)
+      for (auto &b : connection)
+        if (a < b)
+          links.push_back({a, b});
+  return make_topology(tiles, links);
+}